@@ -0,0 +1,111 @@
+// parsing and laying out big pages with every simd level the cpu has
+// build with `make bench` and run e.g.:
+//   ./bench/layout_bench 79 20 4 (width, rounds, threads)
+#include <time.h>
+#include <limits.h>
+
+#include "src/layout.h"
+#include "src/simd.h"
+#include "src/util.h"
+#include "src/pool.h"
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static const char *words[] = {
+  "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor",
+};
+static const char *wide_words[] = {
+  "日本語の", "テキスト", "とても", "長い", "ページ", "Ωμέγα", "déjà", "vu",
+};
+
+// the most one pass of the loop below writes (a paragraph of 44 words of at most 12 bytes)
+#define MAX_PASS_BYTES 4096
+
+// every generated document is about `size` bytes
+static char *make_doc(const char *kind, size_t size) {
+  // a pass starts under size, so it ends before the end of the buffer
+  char *doc = malloc(size + MAX_PASS_BYTES);
+  if(doc == NULL)
+    MALLOC_ERROR;
+
+  size_t len = sprintf(doc, "20 text/gemini\r\n");
+  int i = 0;
+  srand(1);
+  while(len < size) {
+    if(strcmp(kind, "paragraph") == 0) {
+      len += sprintf(doc + len, "%s ", words[rand() % 12]);
+    }
+    else if(strcmp(kind, "wide") == 0) {
+      len += sprintf(doc + len, "%s%s", wide_words[rand() % 8], (++i % 12) ? " " : "\n");
+    }
+    else {
+      // a usual gemtext page
+      switch(i++ % 8) {
+        case 0: len += sprintf(doc + len, "## heading %d\n", i); break;
+        case 1: len += sprintf(doc + len, "=> gemini://example.org/%d a link %d\n", i, i); break;
+        default:
+          for(int w = rand() % 40 + 5; w > 0; w--)
+            len += sprintf(doc + len, "%s ", words[rand() % 12]);
+          doc[len++] = '\n';
+      }
+    }
+  }
+  doc[len] = '\0';
+  return doc;
+}
+
+int main(int argc, char **argv) {
+  int width = argc > 1 ? atoi(argv[1]) : 79;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+  int threads = argc > 3 ? atoi(argv[3]) : 0;
+  pool_init(threads);
+  const char *kinds[] = {"gemtext", "paragraph", "wide"};
+
+  for(size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    char *body = make_doc(kinds[k], 1024 * 1024);
+    size_t size = strlen(body);
+
+    for(enum simd_level level = SIMD_SCALAR; level <= SIMD_AVX2; level++) {
+      simd_set_level(level);
+      if(simd_get_level() != level)
+        continue;
+
+      struct page_t page = {0};
+      double first_ms = 0, parse_ms = 0, layout_ms = 0;
+      for(int r = 0; r < rounds; r++) {
+        // what's done before the first screen is shown
+        double start = now_ms();
+        gemtext_free(&page.doc);
+        gemtext_parse_init(&page.doc, body, size);
+        layout_gemtext(&page, width);
+        layout_ensure_lines(&page, 50);
+        for(int i = 0; i < 50 && i < page.lines_num; i++)
+          page_line(&page, i);
+        first_ms += now_ms() - start;
+
+        start = now_ms();
+        gemtext_parse_bytes(&page.doc, size);
+        parse_ms += now_ms() - start;
+
+        // measuring the rest, for the scrollbar
+        start = now_ms();
+        while(layout_step(&page))
+          ;
+        layout_ms += now_ms() - start;
+      }
+
+      printf("%-9s %-6s %7zu bytes, %6d lines: first screen %5.2f ms, parse %6.2f ms, layout %6.2f ms\n",
+          kinds[k], simd_level_name(), size, page.lines_num, first_ms / rounds, parse_ms / rounds, layout_ms / rounds);
+
+      layout_destroy(&page);
+      gemtext_free(&page.doc);
+    }
+    free(body);
+  }
+  pool_free();
+  return 0;
+}
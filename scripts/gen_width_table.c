@@ -0,0 +1,65 @@
+// generates src/width_table.h, a two-stage lookup table of terminal column widths
+// the widths come from the interval tables in src/wcwidth.c (which are made from the unicode data),
+// so a width is just two loads instead of a binary search
+// usage: gen_width_table > src/width_table.h
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "src/wcwidth.h"
+
+#define MAX_CODEPOINT 0x110000
+#define BLOCK_SHIFT 8
+#define BLOCK_SIZE (1 << BLOCK_SHIFT)
+#define STAGE1_SIZE (MAX_CODEPOINT >> BLOCK_SHIFT)
+
+static unsigned char blocks[STAGE1_SIZE][BLOCK_SIZE];
+static unsigned char stage1[STAGE1_SIZE];
+
+int main(void) {
+  int blocks_num = 0;
+
+  for(int i = 0; i < STAGE1_SIZE; i++) {
+    unsigned char block[BLOCK_SIZE];
+    for(int j = 0; j < BLOCK_SIZE; j++) {
+      int width = mk_wcwidth((i << BLOCK_SHIFT) | j);
+      // not printable characters take no space on the screen
+      block[j] = width < 0 ? 0 : width;
+    }
+
+    // most of the blocks are the same, so they're stored only once
+    int k = 0;
+    while(k < blocks_num && memcmp(blocks[k], block, BLOCK_SIZE) != 0)
+      k++;
+    if(k == blocks_num)
+      memcpy(blocks[blocks_num++], block, BLOCK_SIZE);
+    if(k > 255) {
+      fprintf(stderr, "too many distinct blocks, make BLOCK_SHIFT bigger\n");
+      return EXIT_FAILURE;
+    }
+    stage1[i] = k;
+  }
+
+  printf("// generated by scripts/gen_width_table.c from src/wcwidth.c, don't edit\n");
+  printf("#ifndef WIDTH_TABLE_H\n#define WIDTH_TABLE_H\n\n");
+  printf("#define WIDTH_BLOCK_SHIFT %d\n", BLOCK_SHIFT);
+  printf("#define WIDTH_BLOCK_MASK %d\n", BLOCK_SIZE - 1);
+  printf("#define WIDTH_MAX_CODEPOINT 0x%X\n\n", MAX_CODEPOINT);
+
+  printf("static const unsigned char width_stage1[%d] = {", STAGE1_SIZE);
+  for(int i = 0; i < STAGE1_SIZE; i++)
+    printf("%s%d,", i % 32 ? "" : "\n  ", stage1[i]);
+  printf("\n};\n\n");
+
+  printf("static const unsigned char width_stage2[%d][%d] = {\n", blocks_num, BLOCK_SIZE);
+  for(int k = 0; k < blocks_num; k++) {
+    printf("  {");
+    for(int j = 0; j < BLOCK_SIZE; j++)
+      printf("%s%d,", j % 64 ? "" : "\n    ", blocks[k][j]);
+    printf("\n  },\n");
+  }
+  printf("};\n\n#endif\n");
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#include "arena.h"
+#include "util.h"
+
+#define ARENA_MIN_BLOCK (64 * 1024)
+
+struct arena_block {
+  struct arena_block *next;
+  size_t size, used;
+  alignas(max_align_t) char data[];
+};
+
+static struct arena_block *new_block(struct arena *a, size_t size) {
+  // grow geometrically, so there's only a few blocks even for huge pages
+  size_t block_size = a->blocks ? a->blocks->size * 2 : ARENA_MIN_BLOCK;
+  if(block_size < size)
+    block_size = size;
+
+  struct arena_block *b = malloc(sizeof(struct arena_block) + block_size);
+  if(b == NULL)
+    MALLOC_ERROR;
+
+  b->size = block_size;
+  b->used = 0;
+  b->next = a->blocks;
+  a->blocks = b;
+  a->blocks_num++;
+  return b;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+  size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+  struct arena_block *b = a->blocks;
+  if(b == NULL || b->size - b->used < size)
+    b = new_block(a, size);
+
+  void *p = b->data + b->used;
+  b->used += size;
+  a->allocs++;
+  a->used += size;
+  return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n) {
+  char *p = arena_alloc(a, n + 1);
+  memcpy(p, s, n);
+  p[n] = '\0';
+  return p;
+}
+
+void arena_release(struct arena *a) {
+  if(a->blocks == NULL)
+    return;
+
+  struct arena_block *b = a->blocks->next;
+  while(b) {
+    struct arena_block *next = b->next;
+    free(b);
+    b = next;
+  }
+
+  a->blocks->next = NULL;
+  a->blocks->used = 0;
+  a->blocks_num = 1;
+  a->allocs = 0;
+  a->used = 0;
+}
+
+void arena_free(struct arena *a) {
+  arena_release(a);
+  free(a->blocks);
+  a->blocks = NULL;
+  a->blocks_num = 0;
+}
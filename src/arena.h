@@ -0,0 +1,24 @@
+#ifndef GEMINI_ARENA_H
+#define GEMINI_ARENA_H
+
+#include <stddef.h>
+
+// bump allocator for everything laid out from a page (lines, texts, links)
+// nothing is freed on its own, the whole arena goes at once on navigation or resize
+
+struct arena_block;
+
+struct arena {
+  // the newest (and the biggest) block first
+  struct arena_block *blocks;
+  // for the debug log
+  size_t allocs, blocks_num, used;
+};
+
+void *arena_alloc(struct arena *a, size_t size);
+char *arena_strndup(struct arena *a, const char *s, size_t n);
+// keeps the biggest block for the next page, so a page of the same size doesn't malloc at all
+void arena_release(struct arena *a);
+void arena_free(struct arena *a);
+
+#endif
@@ -0,0 +1,552 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <openssl/evp.h>
+
+#include "cache.h"
+#include "fetch.h"
+#include "hoststats.h"
+#include "io.h"
+#include "util.h"
+
+#define INDEX_FILENAME "index"
+#define PAGES_DIR "pages"
+#define DOC_SUFFIX ".doc"
+#define BUCKETS_NUM 4096
+// revalidations at once, the others wait, the shown page goes first,
+// then the ones expected to be done soonest (see hoststats_expected_ms)
+#define MAX_REVALIDATING 3
+
+struct cache_entry {
+  char *url;
+  char hash[CACHE_HASH_LEN + 1];
+  // of the body, the file has the '\0' after it too
+  size_t size;
+  long fetched;
+  struct cache_entry *next;
+};
+
+// a url fetched again in the background
+struct revalidation {
+  char *url;
+  Gemini_tls gem_tls;
+  // of the version that's shown
+  char hash[CACHE_HASH_LEN + 1];
+  // how long it should take, from the latency history of the host
+  double expected_ms;
+  pthread_t thread;
+  bool is_started;
+  atomic_bool is_finished;
+  // the new version, if it's different
+  struct response *resp;
+  struct revalidation *next;
+};
+
+// the revalidations store into it too
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cache_entry *buckets[BUCKETS_NUM];
+static int entries_num = 0;
+
+// only the ui thread goes through them
+static struct revalidation *revalidations = NULL;
+// the one for the shown page, the others were left for it
+static struct revalidation *current = NULL;
+
+// "gemini://host" and "gemini://host/" are the same page
+static char *url_key(const char *url) {
+  const char *host = strstr(url, "://");
+  host = host ? host + 3 : url;
+  size_t len = strlen(url);
+
+  char *key = malloc(len + 2);
+  if(key == NULL)
+    MALLOC_ERROR;
+  memcpy(key, url, len);
+  if(strchr(host, '/') == NULL)
+    key[len++] = '/';
+  key[len] = '\0';
+  return key;
+}
+
+// fnv-1a
+static unsigned bucket(const char *key) {
+  unsigned h = 2166136261u;
+  for(const unsigned char *p = (const unsigned char*)key; *p; p++)
+    h = (h ^ *p) * 16777619u;
+  return h % BUCKETS_NUM;
+}
+
+// under cache_lock
+static struct cache_entry *find(const char *key) {
+  for(struct cache_entry *e = buckets[bucket(key)]; e; e = e->next)
+    if(strcmp(e->url, key) == 0)
+      return e;
+  return NULL;
+}
+
+// under cache_lock
+static void set_entry(const char *key, const char *hash, size_t size, long fetched) {
+  struct cache_entry *e = find(key);
+  if(e == NULL) {
+    e = calloc(1, sizeof(struct cache_entry));
+    if(e == NULL || (e->url = strdup(key)) == NULL)
+      MALLOC_ERROR;
+    unsigned b = bucket(key);
+    e->next = buckets[b];
+    buckets[b] = e;
+    entries_num++;
+  }
+  memcpy(e->hash, hash, CACHE_HASH_LEN + 1);
+  e->size = size;
+  e->fetched = fetched;
+}
+
+static void hash_response(const struct response *resp, char hash[CACHE_HASH_LEN + 1]) {
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int md_len = 0;
+  if(EVP_Digest(resp->body, resp->body_size, md, &md_len, EVP_sha256(), NULL) != 1)
+    ERROR_LOG_AND_EXIT("cache: can't hash a response");
+  for(unsigned int i = 0; i < md_len; i++)
+    sprintf(hash + 2 * i, "%02x", md[i]);
+}
+
+static void page_path(const char *hash, char path[], int size) {
+  char filename[sizeof(PAGES_DIR) + 1 + CACHE_HASH_LEN + 1];
+  snprintf(filename, sizeof(filename), "%s/%s", PAGES_DIR, hash);
+  get_file_path_in_cache_dir(filename, path, size);
+}
+
+static void doc_path(const char *hash, char path[], int size) {
+  char filename[sizeof(PAGES_DIR) + 1 + CACHE_HASH_LEN + sizeof(DOC_SUFFIX)];
+  snprintf(filename, sizeof(filename), "%s/%s%s", PAGES_DIR, hash, DOC_SUFFIX);
+  get_file_path_in_cache_dir(filename, path, size);
+}
+
+static void store(const char *key, const struct response *resp, const char *hash) {
+  char path[PATH_MAX + 1];
+  page_path(hash, path, sizeof(path));
+  // the same content is there already
+  struct stat st;
+  if(stat(path, &st) == -1 || (size_t)st.st_size != resp->body_size + 1)
+    if(!io_write_file(path, resp->body, resp->body_size + 1, IO_TRUNCATE))
+      ERROR_LOG("Can't write %s: %s", path, strerror(errno));
+
+  long now = time(NULL);
+  pthread_mutex_lock(&cache_lock);
+  set_entry(key, hash, resp->body_size, now);
+  pthread_mutex_unlock(&cache_lock);
+
+  // appended right away, so it isn't lost if we crash, the whole index is written again on exit
+  size_t line_size = CACHE_HASH_LEN + strlen(key) + 64;
+  char *line = malloc(line_size);
+  if(line == NULL)
+    MALLOC_ERROR;
+  int len = snprintf(line, line_size, "%s %zu %ld %s\n", hash, resp->body_size, now, key);
+  char index_path[PATH_MAX + 1];
+  get_file_path_in_cache_dir(INDEX_FILENAME, index_path, sizeof(index_path));
+  if(!io_write_file(index_path, line, len, IO_APPEND))
+    ERROR_LOG("Can't write %s: %s", index_path, strerror(errno));
+  free(line);
+}
+
+void cache_load(void) {
+  char pages_path[PATH_MAX + 1];
+  get_file_path_in_cache_dir(PAGES_DIR, pages_path, sizeof(pages_path));
+  mkdir(pages_path, 0700);
+
+  char index_path[PATH_MAX + 1];
+  get_file_path_in_cache_dir(INDEX_FILENAME, index_path, sizeof(index_path));
+  FILE *f = fopen(index_path, "r");
+  if(f == NULL)
+    return;
+
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  pthread_mutex_lock(&cache_lock);
+  while((len = getline(&line, &cap, f)) > 0) {
+    char hash[CACHE_HASH_LEN + 1];
+    size_t size;
+    long fetched;
+    int url_start;
+    if(sscanf(line, "%64s %zu %ld %n", hash, &size, &fetched, &url_start) != 3 || strlen(hash) != CACHE_HASH_LEN)
+      continue;
+    if(line[len - 1] == '\n')
+      line[len - 1] = '\0';
+    if(line[url_start] == '\0')
+      continue;
+    // a later line is a newer version
+    set_entry(line + url_start, hash, size, fetched);
+  }
+  pthread_mutex_unlock(&cache_lock);
+  free(line);
+  fclose(f);
+  INFO_LOG("cache: %d pages", entries_num);
+}
+
+bool cache_lookup(const char *url, struct response *resp, bool *is_stale, char hash[CACHE_HASH_LEN + 1]) {
+  char *key = url_key(url);
+  size_t size = 0;
+  long fetched = 0;
+
+  pthread_mutex_lock(&cache_lock);
+  struct cache_entry *e = find(key);
+  if(e) {
+    memcpy(hash, e->hash, CACHE_HASH_LEN + 1);
+    size = e->size;
+    fetched = e->fetched;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  free(key);
+  if(e == NULL)
+    return false;
+
+  char path[PATH_MAX + 1];
+  page_path(hash, path, sizeof(path));
+  int fd = open(path, O_RDONLY);
+  if(fd == -1)
+    return false;
+
+  // a file that wasn't written whole isn't used
+  struct stat st;
+  char *body = MAP_FAILED;
+  if(fstat(fd, &st) == 0 && (size_t)st.st_size == size + 1)
+    body = mmap(NULL, size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(body == MAP_FAILED)
+    return false;
+  if(body[size] != '\0') {
+    munmap(body, size + 1);
+    return false;
+  }
+
+  resp->body = body;
+  resp->body_size = size;
+  resp->mapped_size = size + 1;
+  *is_stale = time(NULL) - fetched > CACHE_FRESH_SEC;
+  return true;
+}
+
+bool cache_is_cacheable(const char *url, const struct response *resp) {
+  if(resp->status_code < 20 || resp->status_code > 29 || resp->meta == NULL)
+    return false;
+  if(strncmp(resp->meta, "text/gemini", 11) != 0 && strncmp(resp->meta, "text/plain", 10) != 0)
+    return false;
+  // an answer to some input isn't
+  return resp->body_size <= CACHE_MAX_BODY && strchr(url, '?') == NULL;
+}
+
+void cache_store(const char *url, const struct response *resp) {
+  if(!cache_is_cacheable(url, resp))
+    return;
+
+  char hash[CACHE_HASH_LEN + 1];
+  hash_response(resp, hash);
+  char *key = url_key(url);
+  store(key, resp, hash);
+  free(key);
+}
+
+bool cache_load_doc(struct gemtext_doc *doc, const struct response *resp, const char *hash) {
+  if(resp->body_size < CACHE_MIN_DOC_BYTES)
+    return false;
+
+  char path[PATH_MAX + 1];
+  doc_path(hash, path, sizeof(path));
+  int fd = open(path, O_RDONLY);
+  if(fd == -1)
+    return false;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  // the nodes are only read
+  if(fstat(fd, &st) == 0 && st.st_size > 0)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    return false;
+
+  // an old version of the format (or a broken file), it's written again once the page is parsed
+  if(!gemtext_unpack(doc, resp->body, resp->body_size, hash, map, st.st_size)) {
+    INFO_LOG("cache: %s isn't a parsed page of this version", path);
+    munmap(map, st.st_size);
+    unlink(path);
+    return false;
+  }
+  return true;
+}
+
+void cache_store_doc(const char *url, const struct response *resp, struct gemtext_doc *doc) {
+  if(url == NULL || resp == NULL || doc->is_stored || !gemtext_is_parsed(doc))
+    return;
+  // the others aren't worth it, so they're not looked at again
+  doc->is_stored = true;
+  if(resp->body_size < CACHE_MIN_DOC_BYTES || !cache_is_cacheable(url, resp))
+    return;
+
+  // the body the nodes point into, whatever version of the url the cache has now
+  char hash[CACHE_HASH_LEN + 1];
+  hash_response(resp, hash);
+  char path[PATH_MAX + 1];
+  doc_path(hash, path, sizeof(path));
+  struct stat st;
+  if(stat(path, &st) == 0)
+    return;
+
+  size_t size;
+  char *buf = gemtext_pack(doc, hash, &size);
+  if(buf == NULL)
+    return;
+  if(!io_write_file(path, buf, size, IO_TRUNCATE))
+    ERROR_LOG("Can't write %s: %s", path, strerror(errno));
+  free(buf);
+}
+
+static void *revalidate(void *arg) {
+  struct revalidation *r = arg;
+  struct response *resp = calloc(1, sizeof(struct response));
+  if(resp == NULL)
+    MALLOC_ERROR;
+
+  char fingerprint[100];
+  *fingerprint = '\0';
+  Fetch_conn conn = fetch_conn_new(r->gem_tls, r->url);
+  if(conn) {
+    // a changed certificate is for the user to confirm, not for a fetch in the background
+    if(fetch_connect(conn, r->url, resp, fingerprint) && resp->cert_result != TOFU_FINGERPRINT_MISMATCH)
+      fetch_read(conn, resp);
+    fetch_conn_free(conn);
+  }
+  if(resp->body && resp->error_message == NULL)
+    check_response(resp);
+
+  if(resp->body && resp->error_message == NULL && cache_is_cacheable(r->url, resp)) {
+    char hash[CACHE_HASH_LEN + 1];
+    hash_response(resp, hash);
+    // it's fresh again even if it didn't change
+    store(r->url, resp, hash);
+    if(strcmp(hash, r->hash) != 0) {
+      r->resp = resp;
+      resp = NULL;
+    }
+    INFO_LOG("cache: %s revalidated, %s", r->url, r->resp ? "it changed" : "the same");
+  }
+
+  response_free(resp);
+  atomic_store(&r->is_finished, true);
+  return NULL;
+}
+
+// the waiting ones are started while there's room
+static void start_revalidations(void) {
+  int running = 0;
+  for(struct revalidation *r = revalidations; r; r = r->next)
+    running += r->is_started;
+
+  while(running < MAX_REVALIDATING) {
+    struct revalidation *next = NULL;
+    for(struct revalidation *r = revalidations; r; r = r->next) {
+      if(r->is_started || atomic_load(&r->is_finished))
+        continue;
+      if(r == current) {
+        next = r;
+        break;
+      }
+      if(next == NULL || r->expected_ms < next->expected_ms)
+        next = r;
+    }
+    if(next == NULL)
+      return;
+
+    next->is_started = true;
+    if(pthread_create(&next->thread, NULL, revalidate, next) != 0) {
+      // it's left as it is, like a fetch that failed
+      ERROR_LOG("cache: can't create a thread for revalidating %s", next->url);
+      next->is_started = false;
+      atomic_store(&next->is_finished, true);
+      continue;
+    }
+    running++;
+  }
+}
+
+void cache_revalidate(Gemini_tls gem_tls, const char *url) {
+  struct revalidation *r = calloc(1, sizeof(struct revalidation));
+  if(r == NULL)
+    MALLOC_ERROR;
+  r->url = url_key(url);
+  r->gem_tls = gem_tls;
+
+  size_t size = 0;
+  pthread_mutex_lock(&cache_lock);
+  struct cache_entry *e = find(r->url);
+  if(e) {
+    memcpy(r->hash, e->hash, sizeof(r->hash));
+    size = e->size;
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  if(e == NULL) {
+    free(r->url);
+    free(r);
+    return;
+  }
+  char host[1024];
+  r->expected_ms = fetch_host(r->url, host, sizeof(host)) ? hoststats_expected_ms(host, size) : 0.0;
+
+  r->next = revalidations;
+  revalidations = r;
+  current = r;
+  start_revalidations();
+}
+
+bool cache_is_revalidating(void) {
+  return revalidations != NULL;
+}
+
+// the finished ones are joined (or all of them, the waiting ones aren't started then),
+// only the result of the current one is taken
+static struct response *join_revalidations(bool all, char **url) {
+  struct response *resp = NULL;
+  struct revalidation **p = &revalidations;
+  while(*p) {
+    struct revalidation *r = *p;
+    if(!all && !atomic_load(&r->is_finished)) {
+      p = &r->next;
+      continue;
+    }
+    if(r->is_started)
+      pthread_join(r->thread, NULL);
+    *p = r->next;
+
+    if(r == current) {
+      current = NULL;
+      if(url) {
+        resp = r->resp;
+        *url = r->url;
+        r->resp = NULL;
+        r->url = NULL;
+      }
+    }
+    response_free(r->resp);
+    free(r->url);
+    free(r);
+  }
+  return resp;
+}
+
+struct response *cache_poll_revalidated(char **url) {
+  struct response *resp = join_revalidations(false, url);
+  start_revalidations();
+  return resp;
+}
+
+static int by_fetched(const void *a, const void *b) {
+  long fa = (*(struct cache_entry* const*)a)->fetched;
+  long fb = (*(struct cache_entry* const*)b)->fetched;
+  return (fa < fb) - (fa > fb);
+}
+
+static int by_hash(const void *a, const void *b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+void cache_save(void) {
+  // they may be storing
+  join_revalidations(true, NULL);
+
+  pthread_mutex_lock(&cache_lock);
+  struct cache_entry **entries = malloc((entries_num + 1) * sizeof(struct cache_entry*));
+  if(entries == NULL)
+    MALLOC_ERROR;
+  int n = 0;
+  for(int b = 0; b < BUCKETS_NUM; b++)
+    for(struct cache_entry *e = buckets[b]; e; e = e->next)
+      entries[n++] = e;
+
+  // the newest ones while they fit
+  qsort(entries, n, sizeof(*entries), by_fetched);
+  size_t bytes = 0;
+  int kept = 0;
+  while(kept < n && bytes + entries[kept]->size <= CACHE_MAX_BYTES)
+    bytes += entries[kept++]->size;
+
+  size_t cap = 4096, len = 0;
+  char *buf = malloc(cap);
+  char **hashes = malloc((kept + 1) * sizeof(char*));
+  if(buf == NULL || hashes == NULL)
+    MALLOC_ERROR;
+  for(int i = 0; i < kept; i++) {
+    struct cache_entry *e = entries[i];
+    hashes[i] = e->hash;
+    int written;
+    while((written = snprintf(buf + len, cap - len, "%s %zu %ld %s\n", e->hash, e->size, e->fetched, e->url)) >= 0 &&
+          (size_t)written >= cap - len) {
+      cap *= 2;
+      if((buf = realloc(buf, cap)) == NULL)
+        MALLOC_ERROR;
+    }
+    if(written > 0)
+      len += written;
+  }
+
+  char index_path[PATH_MAX + 1];
+  get_file_path_in_cache_dir(INDEX_FILENAME, index_path, sizeof(index_path));
+  if(!io_write_file(index_path, buf, len, IO_TRUNCATE))
+    ERROR_LOG("Can't save the cache index to %s", index_path);
+
+  // the old versions and the pages that didn't fit
+  qsort(hashes, kept, sizeof(char*), by_hash);
+  char pages_path[PATH_MAX + 1];
+  get_file_path_in_cache_dir(PAGES_DIR, pages_path, sizeof(pages_path));
+  DIR *dir = opendir(pages_path);
+  struct dirent *d;
+  int removed = 0;
+  while(dir && (d = readdir(dir)) != NULL) {
+    // a page or its parsed document
+    char name[CACHE_HASH_LEN + 1];
+    const char *p = name;
+    size_t len = strlen(d->d_name);
+    if(len != CACHE_HASH_LEN && (len != CACHE_HASH_LEN + strlen(DOC_SUFFIX) || strcmp(d->d_name + CACHE_HASH_LEN, DOC_SUFFIX) != 0))
+      continue;
+    memcpy(name, d->d_name, CACHE_HASH_LEN);
+    name[CACHE_HASH_LEN] = '\0';
+    if(bsearch(&p, hashes, kept, sizeof(char*), by_hash))
+      continue;
+    char path[PATH_MAX + 1];
+    if(len == CACHE_HASH_LEN)
+      page_path(name, path, sizeof(path));
+    else
+      doc_path(name, path, sizeof(path));
+    if(unlink(path) == 0)
+      removed++;
+  }
+  if(dir)
+    closedir(dir);
+  pthread_mutex_unlock(&cache_lock);
+
+  INFO_LOG("cache: %d of %d pages kept (%zu KiB), %d files removed", kept, n, bytes / 1024, removed);
+  free(hashes);
+  free(buf);
+  free(entries);
+}
+
+void cache_free(void) {
+  join_revalidations(true, NULL);
+  pthread_mutex_lock(&cache_lock);
+  for(int b = 0; b < BUCKETS_NUM; b++) {
+    struct cache_entry *e = buckets[b];
+    while(e) {
+      struct cache_entry *next = e->next;
+      free(e->url);
+      free(e);
+      e = next;
+    }
+    buckets[b] = NULL;
+  }
+  entries_num = 0;
+  pthread_mutex_unlock(&cache_lock);
+}
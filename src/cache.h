@@ -0,0 +1,52 @@
+#ifndef GEMINI_CACHE_H
+#define GEMINI_CACHE_H
+
+#include <stdbool.h>
+#include "tls.h"
+#include "gemtext.h"
+
+// fetched pages on the disk, in the cache dir
+//   pages/<sha256 of the response>  the whole response (header, body and the '\0' after it), a file per content,
+//                                   so a page under more urls, or one that didn't change, is there once
+//   pages/<hash>.doc                the page parsed (see gemtext_pack), for the bigger ones, so they're not parsed again
+//   index                           "<hash> <size> <fetched at> <url>" lines, the last one of a url is its latest version
+// a cached page is shown right away (its file is mmap'd, not read), if it's older than CACHE_FRESH_SEC
+// it's fetched again in the background, and if it changed, the new version is shown in its place
+
+#define CACHE_FRESH_SEC 60
+// bigger responses aren't cached
+#define CACHE_MAX_BODY (16 * 1024 * 1024)
+// the least recently fetched pages go when the cache is saved
+#define CACHE_MAX_BYTES (256 * 1024 * 1024)
+// a smaller page is parsed sooner than its parsed file is opened
+#define CACHE_MIN_DOC_BYTES (64 * 1024)
+// sha256 in hex
+#define CACHE_HASH_LEN 64
+
+void cache_load(void);
+// waits for the revalidations still running, writes the index again without the old versions
+// and removes the files nobody points to
+void cache_save(void);
+void cache_free(void);
+
+// the latest version of the url, the body is mapped into resp (see mapped_size),
+// is_stale is set if it should be revalidated and hash to what it's known by, false if it isn't cached
+bool cache_lookup(const char *url, struct response *resp, bool *is_stale, char hash[CACHE_HASH_LEN + 1]);
+// only a successful text response without a query is cached
+bool cache_is_cacheable(const char *url, const struct response *resp);
+void cache_store(const char *url, const struct response *resp);
+// the document of a looked up response from its parsed file (mapped, not parsed), false if there's none
+bool cache_load_doc(struct gemtext_doc *doc, const struct response *resp, const char *hash);
+// once the response is all parsed, its document is written next to it (if it's cached and big enough)
+void cache_store_doc(const char *url, const struct response *resp, struct gemtext_doc *doc);
+
+// the url is fetched again on its own thread, a revalidation still running for another url
+// is left to finish on its own (it only updates the cache then), when too many of them are running,
+// it waits, but it's the first one started, the others go from the host that should be the fastest
+void cache_revalidate(Gemini_tls gem_tls, const char *url);
+bool cache_is_revalidating(void);
+// once the current revalidation is done, *url is set to its url (the caller owns it),
+// returns the new version if it's different (the caller owns it too), NULL otherwise
+struct response *cache_poll_revalidated(char **url);
+
+#endif
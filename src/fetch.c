@@ -0,0 +1,141 @@
+#include <string.h>
+#include <ctype.h>
+
+#include "fetch.h"
+#include "plain.h"
+#include "util.h"
+
+static int gemini_connect(struct fetch_conn *conn, const char *url, struct response *resp, char fingerprint[]) {
+  conn->tls = tls_conn_new(conn->gem_tls);
+  return tls_connect(conn->tls, url, resp, fingerprint);
+}
+
+static int gemini_read(struct fetch_conn *conn, struct response *resp) {
+  return tls_read(conn->tls, resp);
+}
+
+static void gemini_close(struct fetch_conn *conn) {
+  tls_conn_free(conn->tls);
+  conn->tls = NULL;
+}
+
+static const struct fetch_backend gemini_backend = {
+  .protocol = GEMINI,
+  .default_port = "1965",
+  .connect = gemini_connect,
+  .read = gemini_read,
+  .close = gemini_close,
+};
+
+static const struct fetch_backend *backends[] = {
+  &gemini_backend,
+  &spartan_backend,
+  &finger_backend,
+  &gopher_backend,
+};
+
+
+enum protocols get_protocol(const char *str) {
+  static const struct {
+    const char *prefix;
+    enum protocols protocol;
+  } prefixes[] = {
+    { "gemini://",  GEMINI  },
+    { "//",         GEMINI  },
+    { "https://",   HTTPS   },
+    { "http://",    HTTP    },
+    { "gopher://",  GOPHER  },
+    { "mailto:",    MAIL    },
+    { "finger://",  FINGER  },
+    { "spartan://", SPARTAN },
+  };
+
+  for(size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+    if(strncmp(str, prefixes[i].prefix, strlen(prefixes[i].prefix)) == 0)
+      return prefixes[i].protocol;
+  }
+  return null;
+}
+
+// "host:1965/" has no scheme, "mailto:" or "irc://" has
+static bool has_scheme(const char *url) {
+  const char *p = url;
+  while(isalnum((unsigned char)*p) || *p == '+' || *p == '-' || *p == '.')
+    p++;
+  return p != url && *p == ':' && !isdigit((unsigned char)p[1]);
+}
+
+const struct fetch_backend *fetch_get_backend(const char *url) {
+  enum protocols protocol = get_protocol(url);
+  // everything without a scheme is a gemini url (typed in the search bar)
+  if(protocol == null && !has_scheme(url))
+    protocol = GEMINI;
+
+  for(size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    if(backends[i]->protocol == protocol)
+      return backends[i];
+  }
+  return NULL;
+}
+
+bool fetch_is_native(enum protocols protocol) {
+  for(size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    if(backends[i]->protocol == protocol)
+      return true;
+  }
+  return false;
+}
+
+bool fetch_host(const char *url, char host[], size_t size) {
+  const struct fetch_backend *backend = fetch_get_backend(url);
+  if(backend == NULL)
+    return false;
+
+  char *hostname = strdup(url), *resource = NULL, port[6] = {0};
+  const char *error_message = NULL;
+  if(hostname == NULL)
+    MALLOC_ERROR;
+  bool ok = parse_url(&error_message, hostname, &resource, port, backend->default_port);
+  if(ok)
+    snprintf(host, size, "%s:%s", hostname, port);
+  free(resource);
+  free(hostname);
+  return ok;
+}
+
+struct fetch_conn *fetch_conn_new(Gemini_tls gem_tls, const char *url) {
+  const struct fetch_backend *backend = fetch_get_backend(url);
+  if(backend == NULL)
+    return NULL;
+
+  struct fetch_conn *conn = (struct fetch_conn*) calloc(1, sizeof(struct fetch_conn));
+  if(conn == NULL)
+    MALLOC_ERROR;
+
+  conn->backend = backend;
+  conn->gem_tls = gem_tls;
+  conn->fd = -1;
+  return conn;
+}
+
+int fetch_connect(struct fetch_conn *conn, const char *url, struct response *resp, char fingerprint[]) {
+  return conn->backend->connect(conn, url, resp, fingerprint);
+}
+
+int fetch_read(struct fetch_conn *conn, struct response *resp) {
+  return conn->backend->read(conn, resp);
+}
+
+void fetch_trust_cert(struct fetch_conn *conn, char fingerprint[]) {
+  // only gemini has certificates
+  if(conn->tls)
+    tls_trust_cert(conn->tls, fingerprint);
+}
+
+void fetch_conn_free(struct fetch_conn *conn) {
+  if(conn == NULL)
+    return;
+  conn->backend->close(conn);
+  free(conn->host);
+  free(conn);
+}
@@ -0,0 +1,51 @@
+#ifndef GEMINI_FETCH_H
+#define GEMINI_FETCH_H
+
+#include <stdbool.h>
+#include "tls.h"
+
+enum protocols {HTTPS, HTTP, GOPHER, MAIL, FINGER, SPARTAN, GEMINI, null};
+
+struct fetch_conn;
+
+// a protocol the client fetches by itself
+// every backend fills the response the gemini way ("<STATUS> <META>\r\n<BODY>"),
+// so the other protocols are shown by the same page pipeline
+struct fetch_backend {
+  enum protocols protocol;
+  const char *default_port;
+  // connects and sends the request
+  int (*connect)(struct fetch_conn *conn, const char *url, struct response *resp, char fingerprint[]);
+  int (*read)(struct fetch_conn *conn, struct response *resp);
+  void (*close)(struct fetch_conn *conn);
+};
+
+struct fetch_conn {
+  const struct fetch_backend *backend;
+  Gemini_tls gem_tls;
+  // gemini
+  Gemini_conn tls;
+  // plain TCP backends
+  int fd;
+  // "hostname:port"
+  char *host;
+  // gopher item type of the requested selector
+  char item_type;
+};
+
+typedef struct fetch_conn *Fetch_conn;
+
+enum protocols get_protocol(const char *str);
+// NULL if there's no native backend for the url (e.g. https://)
+const struct fetch_backend *fetch_get_backend(const char *url);
+bool fetch_is_native(enum protocols protocol);
+// "hostname:port" of the url (the latency history is kept for it), false if it isn't fetched natively
+bool fetch_host(const char *url, char host[], size_t size);
+
+Fetch_conn fetch_conn_new(Gemini_tls gem_tls, const char *url);
+int fetch_connect(Fetch_conn conn, const char *url, struct response *resp, char fingerprint[]);
+int fetch_read(Fetch_conn conn, struct response *resp);
+void fetch_trust_cert(Fetch_conn conn, char fingerprint[]);
+void fetch_conn_free(Fetch_conn conn);
+
+#endif
@@ -0,0 +1,336 @@
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "gemtext.h"
+#include "util.h"
+#include "simd.h"
+#include "pool.h"
+
+// smaller parts of a body aren't worth splitting between threads
+#define PARALLEL_MIN_BYTES (1024 * 1024)
+// a few chunks per thread, so a slow one doesn't hold up the rest
+#define CHUNKS_PER_THREAD 4
+// lines parsed at once when it's not split
+#define PARSE_BATCH 256
+#define TOGGLE "```"
+
+#define DOC_MAGIC "GEMDOC"
+// a change of the nodes or of how they're parsed needs a new one, the old files aren't used then
+#define DOC_VERSION 2
+#define DOC_BYTE_ORDER 0x01020304u
+
+// a parsed document file, the nodes follow it as they are in the memory,
+// so a mapped file is used as it is (the header keeps them aligned)
+struct doc_header {
+  char magic[8];
+  uint32_t version;
+  // a build with other nodes (or another byte order) can't read them
+  uint32_t node_size;
+  uint32_t byte_order;
+  uint32_t nodes_num;
+  // where the page ends, its first '\0'
+  uint64_t end;
+  uint32_t is_preformatted;
+  // the body it was parsed from, not null terminated if it's the whole length
+  char key[GEMTEXT_KEY_MAX];
+};
+
+_Static_assert(sizeof(struct doc_header) % _Alignof(struct gemtext_node) == 0, "the nodes after the header have to be aligned");
+
+// a part of the body parsed on its own, it starts at a line
+struct parse_chunk {
+  struct gemtext_doc *doc;
+  const char *start, *end;
+  // from the prescan
+  int nodes_num, toggles_num;
+  const char *nul;
+  // the index of the first node and if it's in a preformatted block, from the chunks before
+  int first_node;
+  int is_preformatted;
+};
+
+static inline int starts_with(const char *s, const char *end, const char *prefix) {
+  size_t n = strlen(prefix);
+  return (size_t)(end - s) >= n && memcmp(s, prefix, n) == 0;
+}
+
+static inline const char *skip_spaces(const char *s, const char *end) {
+  while(s < end && (*s == ' ' || *s == '\t'))
+    s++;
+  return s;
+}
+
+static inline struct gemtext_span make_span(const struct gemtext_doc *doc, const char *start, const char *end) {
+  return (struct gemtext_span) { .offset = start - doc->body, .len = end - start };
+}
+
+static void parse_link(struct gemtext_doc *doc, struct gemtext_node *node, const char *s, const char *end) {
+  // =>[<whitespace>]<URL>[<whitespace><USER-FRIENDLY LINK NAME>]
+  const char *url = skip_spaces(s + 2, end), *url_end = url;
+  while(url_end < end && !isspace((unsigned char)*url_end))
+    url_end++;
+
+  node->url = make_span(doc, url, url_end);
+
+  const char *label = skip_spaces(url_end, end);
+  // if there is no label then show the plain url
+  if(label == end)
+    node->text = node->url;
+  else
+    node->text = make_span(doc, label, end);
+}
+
+static void parse_line(struct gemtext_doc *doc, struct gemtext_node *node, const char *s, const char *end, int *is_preformatted) {
+  memset(node, 0, sizeof(*node));
+  node->line = make_span(doc, s, end);
+  node->text = node->line;
+  node->type = GEMTEXT_TEXT;
+
+  if(starts_with(s, end, "```")) {
+    *is_preformatted = !*is_preformatted;
+    node->type = GEMTEXT_PRE_TOGGLE;
+    node->text = make_span(doc, skip_spaces(s + 3, end), end);
+  }
+  else if(*is_preformatted) {
+    node->type = GEMTEXT_PRE;
+  }
+  else if(starts_with(s, end, "=>")) {
+    node->type = GEMTEXT_LINK;
+    parse_link(doc, node, s, end);
+  }
+  else if(s < end && *s == '#') {
+    int level = 1;
+    while(level < 3 && s + level < end && s[level] == '#')
+      level++;
+    node->type = GEMTEXT_HEADING;
+    node->level = level;
+    node->text = make_span(doc, skip_spaces(s + level, end), end);
+  }
+  else if(s < end && *s == '>') {
+    node->type = GEMTEXT_QUOTE;
+    node->text = make_span(doc, skip_spaces(s + 1, end), end);
+  }
+  else if(starts_with(s, end, "* ")) {
+    node->type = GEMTEXT_LIST_ITEM;
+    node->text = make_span(doc, skip_spaces(s + 2, end), end);
+  }
+}
+
+void gemtext_parse_init(struct gemtext_doc *doc, const char *body, size_t size) {
+  memset(doc, 0, sizeof(*doc));
+  doc->body = body;
+  doc->end = body + size;
+  doc->parse_pos = body;
+}
+
+static int grow_nodes(struct gemtext_doc *doc, int cap) {
+  if(doc->lock)
+    pthread_mutex_lock(doc->lock);
+  struct gemtext_node *nodes = realloc(doc->nodes, cap * sizeof(struct gemtext_node));
+  if(nodes) {
+    doc->nodes = nodes;
+    doc->nodes_cap = cap;
+  }
+  if(doc->lock)
+    pthread_mutex_unlock(doc->lock);
+  return nodes ? 0 : -1;
+}
+
+int gemtext_parse_more(struct gemtext_doc *doc, int n) {
+  const char *line = doc->parse_pos;
+
+  while(doc->nodes_num < n && line < doc->end) {
+    if(doc->nodes_num == doc->nodes_cap) {
+      int cap = doc->nodes_cap ? doc->nodes_cap * 2 : 256;
+      if(grow_nodes(doc, cap) == -1)
+        return -1;
+    }
+
+    const char *nl = simd_find_byte(line, doc->end - line, '\n');
+    const char *line_end = nl ? nl : doc->end;
+    // the page ends with the first '\0'
+    const char *nul = memchr(line, '\0', line_end - line);
+    if(nul) {
+      line_end = doc->end = nul;
+      if(line == nul)
+        break;
+    }
+
+    // some servers end lines with "\r\n"
+    const char *text_end = line_end;
+    if(text_end > line && text_end[-1] == '\r')
+      text_end--;
+
+    parse_line(doc, &doc->nodes[doc->nodes_num++], line, text_end, &doc->is_preformatted);
+    line = line_end < doc->end ? line_end + 1 : doc->end;
+  }
+
+  doc->parse_pos = line;
+  return doc->nodes_num;
+}
+
+static const char *next_line(const char *s, const char *end) {
+  const char *nl = simd_find_byte(s, end - s, '\n');
+  return nl ? nl + 1 : end;
+}
+
+// lines, and how many of them start with ``` (so the preformatted state after it is known)
+static void prescan_task(void *arg, int task) {
+  struct parse_chunk *c = (struct parse_chunk*)arg + task;
+
+  c->nul = memchr(c->start, '\0', c->end - c->start);
+  const char *end = c->nul ? c->nul : c->end;
+
+  c->nodes_num = simd_count_byte(c->start, end - c->start, '\n');
+  if(end > c->start && end[-1] != '\n')
+    c->nodes_num++;
+
+  c->toggles_num = 0;
+  for(const char *s = c->start; s < end; s = next_line(s, end))
+    if(starts_with(s, end, TOGGLE))
+      c->toggles_num++;
+}
+
+static void parse_task(void *arg, int task) {
+  struct parse_chunk *c = (struct parse_chunk*)arg + task;
+  struct gemtext_node *node = &c->doc->nodes[c->first_node];
+
+  const char *line = c->start;
+  while(line < c->end) {
+    const char *line_end = simd_find_byte(line, c->end - line, '\n');
+    if(line_end == NULL)
+      line_end = c->end;
+    const char *text_end = line_end;
+    if(text_end > line && text_end[-1] == '\r')
+      text_end--;
+
+    parse_line(c->doc, node++, line, text_end, &c->is_preformatted);
+    line = line_end + 1;
+  }
+  assert(node - &c->doc->nodes[c->first_node] == c->nodes_num);
+}
+
+int gemtext_parse_bytes(struct gemtext_doc *doc, size_t bytes) {
+  size_t left = doc->end - doc->parse_pos;
+  if(bytes > left)
+    bytes = left;
+
+  int chunks_num = pool_threads() * CHUNKS_PER_THREAD;
+  if(pool_threads() == 1 || bytes < PARALLEL_MIN_BYTES) {
+    // the same as a line by line parse
+    const char *slice_end = doc->parse_pos + bytes;
+    while(doc->parse_pos < slice_end && !gemtext_is_parsed(doc))
+      if(gemtext_parse_more(doc, doc->nodes_num + PARSE_BATCH) == -1)
+        return -1;
+    return doc->nodes_num;
+  }
+
+  // every chunk starts at a line
+  struct parse_chunk chunks[chunks_num];
+  const char *start = doc->parse_pos, *slice_end = doc->parse_pos + bytes;
+  for(int i = 0; i < chunks_num; i++) {
+    const char *end = (i == chunks_num - 1) ? slice_end : start + bytes / chunks_num;
+    if(end > start)
+      end = next_line(end - 1, doc->end);
+    else
+      end = start;
+    chunks[i] = (struct parse_chunk) { .doc = doc, .start = start, .end = end };
+    start = end;
+  }
+  pool_run(prescan_task, chunks, chunks_num);
+
+  // the page ends at the first '\0', so do the chunks
+  int nodes_num = doc->nodes_num, toggles_num = doc->is_preformatted;
+  for(int i = 0; i < chunks_num; i++) {
+    chunks[i].first_node = nodes_num;
+    chunks[i].is_preformatted = toggles_num % 2;
+    nodes_num += chunks[i].nodes_num;
+    toggles_num += chunks[i].toggles_num;
+
+    if(chunks[i].nul) {
+      doc->end = chunks[i].end = chunks[i].nul;
+      chunks_num = i + 1;
+      break;
+    }
+  }
+
+  if(nodes_num > doc->nodes_cap && grow_nodes(doc, nodes_num) == -1)
+    return -1;
+  pool_run(parse_task, chunks, chunks_num);
+
+  doc->is_preformatted = toggles_num % 2;
+  doc->nodes_num = nodes_num;
+  doc->parse_pos = chunks[chunks_num - 1].end;
+  return doc->nodes_num;
+}
+
+int gemtext_parse(struct gemtext_doc *doc, const char *body, size_t size) {
+  gemtext_parse_init(doc, body, size);
+  return gemtext_parse_more(doc, INT_MAX) != -1;
+}
+
+void gemtext_free(struct gemtext_doc *doc) {
+  if(doc->map)
+    munmap(doc->map, doc->map_size);
+  else
+    free(doc->nodes);
+  doc->map = NULL;
+  doc->map_size = 0;
+  doc->nodes = NULL;
+  doc->nodes_num = 0;
+  doc->nodes_cap = 0;
+  doc->body = NULL;
+}
+
+char *gemtext_pack(const struct gemtext_doc *doc, const char *key, size_t *size) {
+  if(!gemtext_is_parsed(doc) || strlen(key) > GEMTEXT_KEY_MAX)
+    return NULL;
+
+  size_t nodes_size = (size_t)doc->nodes_num * sizeof(struct gemtext_node);
+  char *buf = calloc(1, sizeof(struct doc_header) + nodes_size);
+  if(buf == NULL)
+    MALLOC_ERROR;
+
+  struct doc_header *h = (struct doc_header*)buf;
+  memcpy(h->magic, DOC_MAGIC, sizeof(DOC_MAGIC));
+  h->version = DOC_VERSION;
+  h->node_size = sizeof(struct gemtext_node);
+  h->byte_order = DOC_BYTE_ORDER;
+  h->nodes_num = doc->nodes_num;
+  h->end = doc->end - doc->body;
+  h->is_preformatted = doc->is_preformatted;
+  strncpy(h->key, key, GEMTEXT_KEY_MAX);
+  if(nodes_size)
+    memcpy(buf + sizeof(*h), doc->nodes, nodes_size);
+
+  *size = sizeof(*h) + nodes_size;
+  return buf;
+}
+
+bool gemtext_unpack(struct gemtext_doc *doc, const char *body, size_t size, const char *key, void *map, size_t map_size) {
+  const struct doc_header *h = map;
+  if(map_size < sizeof(*h) || memcmp(h->magic, DOC_MAGIC, sizeof(DOC_MAGIC)) != 0 ||
+     h->version != DOC_VERSION || h->node_size != sizeof(struct gemtext_node) || h->byte_order != DOC_BYTE_ORDER)
+    return false;
+  if(strncmp(h->key, key, GEMTEXT_KEY_MAX) != 0 || h->end > size ||
+     map_size != sizeof(*h) + (size_t)h->nodes_num * sizeof(struct gemtext_node))
+    return false;
+
+  struct gemtext_node *nodes = (struct gemtext_node*)((char*)map + sizeof(*h));
+  // the last line ends the page, a node out of it means it's not the body it was made of
+  if(h->nodes_num && nodes[h->nodes_num - 1].line.offset + nodes[h->nodes_num - 1].line.len > h->end)
+    return false;
+
+  gemtext_parse_init(doc, body, size);
+  doc->end = doc->parse_pos = body + h->end;
+  doc->nodes = nodes;
+  doc->nodes_num = doc->nodes_cap = h->nodes_num;
+  doc->is_preformatted = h->is_preformatted;
+  doc->map = map;
+  doc->map_size = map_size;
+  doc->is_stored = true;
+  return true;
+}
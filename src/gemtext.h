@@ -0,0 +1,90 @@
+#ifndef GEMINI_GEMTEXT_H
+#define GEMINI_GEMTEXT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// a gemtext page parsed once into typed nodes, independent of the terminal width
+// nodes don't copy anything, they only point into the response body,
+// so the body has to live as long as the document
+
+enum gemtext_type {
+  GEMTEXT_TEXT,
+  GEMTEXT_HEADING,
+  GEMTEXT_LINK,
+  GEMTEXT_QUOTE,
+  GEMTEXT_LIST_ITEM,
+  // the ``` line itself, text is the alt text
+  GEMTEXT_PRE_TOGGLE,
+  // a line inside of a preformatted block
+  GEMTEXT_PRE,
+};
+
+struct gemtext_span {
+  size_t offset;
+  size_t len;
+};
+
+struct gemtext_node {
+  enum gemtext_type type;
+  // 1-3 for headings
+  int level;
+  // the whole line, without "\r\n"
+  struct gemtext_span line;
+  // heading/quote/list item text, link label (the url if there's none), alt text
+  struct gemtext_span text;
+  // links only, empty for "=>" without anything
+  struct gemtext_span url;
+};
+
+struct gemtext_doc {
+  const char *body;
+  // the end of the body, or its first '\0' once it's found
+  const char *end;
+  // a big body is parsed as far as it's shown, the rest is done later
+  struct gemtext_node *nodes;
+  int nodes_num, nodes_cap;
+  const char *parse_pos;
+  int is_preformatted;
+  // held while the nodes are moved, if they're read on another thread
+  pthread_mutex_t *lock;
+  // the nodes are where a parsed document file is mapped (see gemtext_unpack), they're unmapped, not freed
+  void *map;
+  size_t map_size;
+  // it was loaded from a parsed document file, or it was written into one (or it isn't worth it)
+  bool is_stored;
+};
+
+// what a body is known by in a parsed document file (its sha256 in hex), at most this long
+#define GEMTEXT_KEY_MAX 64
+
+// nothing is parsed yet, so it doesn't depend on the size
+void gemtext_parse_init(struct gemtext_doc *doc, const char *body, size_t size);
+// parses the next lines, so there are at least n nodes (unless it ends sooner), 
+// returns the number of nodes or -1 if out of memory
+int gemtext_parse_more(struct gemtext_doc *doc, int n);
+// parses about the next bytes of the body (up to the end of a line), 
+// a big part is split between the pool's threads, returns the same as gemtext_parse_more
+int gemtext_parse_bytes(struct gemtext_doc *doc, size_t bytes);
+// the whole body at once, returns 0 if out of memory
+int gemtext_parse(struct gemtext_doc *doc, const char *body, size_t size);
+void gemtext_free(struct gemtext_doc *doc);
+
+// a whole parsed document as a file, so the body isn't parsed again when it's opened the next time,
+// returns a malloc'd buffer of *size bytes, or NULL if it isn't all parsed yet
+char *gemtext_pack(const struct gemtext_doc *doc, const char *key, size_t *size);
+// the document of the body from a mapped file of gemtext_pack, nothing is parsed, the nodes are used
+// where they're mapped and the doc owns the mapping then, returns false (and the map is left to the caller)
+// if the file is of another body, another version of the format or it isn't whole
+bool gemtext_unpack(struct gemtext_doc *doc, const char *body, size_t size, const char *key, void *map, size_t map_size);
+
+static inline bool gemtext_is_parsed(const struct gemtext_doc *doc) {
+  return doc->parse_pos == doc->end;
+}
+
+static inline const char *gemtext_ptr(const struct gemtext_doc *doc, struct gemtext_span span) {
+  return doc->body + span.offset;
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include "history.h"
+#include "layout.h"
+#include "util.h"
+
+// the oldest one first
+static struct history_list_t *first = NULL, *last = NULL;
+static struct history_list_t *current = NULL;
+// the entry the next pushed page goes to
+static struct history_list_t *target = NULL;
+static int entries_num = 0;
+static size_t kept_bytes = 0;
+static unsigned long shown_num = 0;
+
+static size_t page_size(const struct page_t *page, const struct response *resp) {
+  return sizeof(*page) + sizeof(*resp) + resp->body_size +
+    page->doc.nodes_cap * sizeof(struct gemtext_node) + layout_memory(page);
+}
+
+// the page and the response go into the entry
+static void keep(struct history_list_t *e, struct page_t *page, struct response **resp) {
+  e->page = calloc(1, sizeof(struct page_t));
+  if(e->page == NULL)
+    MALLOC_ERROR;
+  layout_move(e->page, page);
+  e->resp = *resp;
+  *resp = NULL;
+
+  free(e->url);
+  e->url = strdup(e->page->url);
+  if(e->url == NULL)
+    MALLOC_ERROR;
+
+  e->size = page_size(e->page, e->resp);
+  kept_bytes += e->size;
+}
+
+// and out of it
+static void take(struct history_list_t *e, struct page_t *page, struct response **resp) {
+  layout_move(page, e->page);
+  free(e->page);
+  e->page = NULL;
+  *resp = e->resp;
+  e->resp = NULL;
+
+  kept_bytes -= e->size;
+  e->size = 0;
+}
+
+static void forget_page(struct history_list_t *e) {
+  if(e->page == NULL)
+    return;
+  layout_destroy(e->page);
+  gemtext_free(&e->page->doc);
+  free(e->page->url);
+  free(e->page);
+  response_free(e->resp);
+  e->page = NULL;
+  e->resp = NULL;
+
+  kept_bytes -= e->size;
+  e->size = 0;
+}
+
+static void remove_entry(struct history_list_t *e) {
+  forget_page(e);
+  if(e->prev)
+    e->prev->next = e->next;
+  else
+    first = e->next;
+  if(e->next)
+    e->next->prev = e->prev;
+  else
+    last = e->prev;
+
+  free(e->url);
+  free(e);
+  entries_num--;
+}
+
+// the least recently shown pages go until the rest fits
+static void evict(void) {
+  while(kept_bytes > HISTORY_MAX_BYTES) {
+    struct history_list_t *lru = NULL;
+    for(struct history_list_t *e = first; e; e = e->next)
+      if(e->page && (lru == NULL || e->used < lru->used))
+        lru = e;
+    if(lru == NULL)
+      break;
+
+    INFO_LOG("history: %s isn't kept anymore (%zu KiB)", lru->url, lru->size / 1024);
+    forget_page(lru);
+  }
+}
+
+void history_push(struct page_t *page, struct response **resp) {
+  if(current && page->url && *resp)
+    keep(current, page, resp);
+
+  if(target) {
+    current = target;
+    target = NULL;
+  }
+  else {
+    // a new way from here
+    while(current && current->next)
+      remove_entry(current->next);
+    if(entries_num >= HISTORY_MAX_ENTRIES)
+      remove_entry(first);
+
+    struct history_list_t *e = calloc(1, sizeof(struct history_list_t));
+    if(e == NULL)
+      MALLOC_ERROR;
+    e->prev = last;
+    if(last)
+      last->next = e;
+    else
+      first = e;
+    last = e;
+    entries_num++;
+    current = e;
+  }
+
+  current->used = ++shown_num;
+  evict();
+}
+
+struct history_list_t *history_peek(int dir) {
+  if(current == NULL)
+    return NULL;
+  return dir < 0 ? current->prev : current->next;
+}
+
+void history_swap(struct history_list_t *entry, struct page_t *page, struct response **resp) {
+  assert(entry->page && entry != current);
+  keep(current, page, resp);
+  take(entry, page, resp);
+  current = entry;
+  current->used = ++shown_num;
+  evict();
+}
+
+void history_set_target(struct history_list_t *entry) {
+  target = entry;
+}
+
+void history_free(void) {
+  while(first)
+    remove_entry(first);
+  current = target = NULL;
+}
@@ -4,12 +4,38 @@
 #include "page.h"
 #include "tls.h"
 
+// the visited pages, back and forward go along the list
+// the recently shown ones are kept whole (the body, its document, the laid out lines
+// and where it was scrolled), so going back to them is only swapping them with the shown page,
+// the least recently shown ones go when they take too much memory, only their url stays and they're fetched again
+
+// for the kept pages, the shown one isn't counted
+#define HISTORY_MAX_BYTES (64 * 1024 * 1024)
+// the oldest ones are forgotten
+#define HISTORY_MAX_ENTRIES 256
+
 struct history_list_t {
-  struct page_t page;
-  struct response resp;
+  // NULL until the page is left
+  char *url;
+  // NULL if it isn't kept, or it's the current one (that's the shown page)
+  struct page_t *page;
+  struct response *resp;
+  // what the kept page takes, about
+  size_t size;
+  // when it was shown last
+  unsigned long used;
   struct history_list_t *next, *prev;
 };
 
-struct history_list_t *add_next_node(struct history_list_t *list, struct history_list_t *node);
+// a new page is going to be shown, the shown one (page and *resp) is kept in the current entry,
+// they're empty after it, the new page gets an entry after the current one (the ones forward are forgotten)
+void history_push(struct page_t *page, struct response **resp);
+// the entry before (dir < 0) or after the current one, NULL if there's none
+struct history_list_t *history_peek(int dir);
+// the shown page is kept and the one of the entry (it has to be kept) is shown in its place
+void history_swap(struct history_list_t *entry, struct page_t *page, struct response **resp);
+// the next pushed page goes into the entry, it's the one fetched again (NULL to forget it)
+void history_set_target(struct history_list_t *entry);
+void history_free(void);
 
 #endif
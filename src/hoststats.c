@@ -0,0 +1,241 @@
+#include <pthread.h>
+#include <time.h>
+
+#include "hoststats.h"
+#include "util.h"
+#include "io.h"
+
+#define STATS_FILENAME "host_stats"
+
+// nothing known about the host
+#define DEFAULT_TIMEOUT_MS 5000.0
+#define MAX_TIMEOUT_MS     5000.0
+// a normally fast host should fail well under a second
+#define MIN_CONNECT_TIMEOUT_MS 400.0
+// the response is already coming, but give it a bit more
+#define MIN_READ_TIMEOUT_MS 1000.0
+// the server may be generating the page (a cgi), so the first byte gets at least what it always did,
+// and more from a host known to be slow at it
+#define MIN_FIRST_BYTE_TIMEOUT_MS DEFAULT_TIMEOUT_MS
+#define MAX_FIRST_BYTE_TIMEOUT_MS 30000.0
+
+static struct host_stats *stats = NULL;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct host_stats *find_host(const char *host, bool create) {
+  struct host_stats *s = stats;
+  while(s) {
+    if(strcmp(s->host, host) == 0)
+      return s;
+    s = s->next;
+  }
+  if(!create)
+    return NULL;
+
+  s = (struct host_stats*) calloc(1, sizeof(struct host_stats));
+  if(s == NULL || (s->host = strdup(host)) == NULL)
+    MALLOC_ERROR;
+  s->next = stats;
+  stats = s;
+  return s;
+}
+
+static double ewma(double avg, double sample) {
+  return avg == 0.0 ? sample : avg * 7.0 / 8.0 + sample / 8.0;
+}
+
+static double clamp(double ms, double min, double max) {
+  if(ms < min) return min;
+  if(ms > max) return max;
+  return ms;
+}
+
+static struct timeval ms_to_timeval(double ms) {
+  struct timeval tv;
+  tv.tv_sec = (long)(ms / 1000.0);
+  tv.tv_usec = (long)((ms - tv.tv_sec * 1000.0) * 1000.0);
+  return tv;
+}
+
+void hoststats_load(void) {
+  char stats_path[PATH_MAX + 1];
+  get_file_path_in_data_dir(STATS_FILENAME, stats_path, sizeof(stats_path));
+
+  FILE *f = fopen(stats_path, "r");
+  if(f == NULL)
+    return;
+
+  pthread_mutex_lock(&stats_lock);
+  char line[1200], host[1024];
+  struct host_stats tmp;
+  while(fgets(line, sizeof(line), f)) {
+    // the older files don't have the first byte
+    tmp.first_byte_ms = 0.0;
+    if(sscanf(line, "%1023s %lf %lf %lf %lf %u %ld %lf", host, &tmp.srtt_ms, &tmp.rttvar_ms,
+        &tmp.handshake_ms, &tmp.throughput, &tmp.samples, &tmp.last_seen, &tmp.first_byte_ms) < 7)
+      continue;
+    struct host_stats *s = find_host(host, true);
+    tmp.host = s->host;
+    tmp.next = s->next;
+    *s = tmp;
+  }
+  pthread_mutex_unlock(&stats_lock);
+  fclose(f);
+}
+
+void hoststats_save(void) {
+  char stats_path[PATH_MAX + 1];
+  get_file_path_in_data_dir(STATS_FILENAME, stats_path, sizeof(stats_path));
+
+  size_t cap = 4096, len = 0;
+  char *buf = malloc(cap);
+  if(buf == NULL)
+    MALLOC_ERROR;
+
+  pthread_mutex_lock(&stats_lock);
+  for(struct host_stats *s = stats; s; s = s->next) {
+    int n;
+    while((n = snprintf(buf + len, cap - len, "%s %.3f %.3f %.3f %.3f %u %ld %.3f\n", s->host, s->srtt_ms,
+            s->rttvar_ms, s->handshake_ms, s->throughput, s->samples, s->last_seen, s->first_byte_ms)) >= 0 &&
+          (size_t)n >= cap - len) {
+      cap *= 2;
+      if((buf = realloc(buf, cap)) == NULL)
+        MALLOC_ERROR;
+    }
+    if(n > 0)
+      len += n;
+  }
+  pthread_mutex_unlock(&stats_lock);
+
+  if(!io_write_file(stats_path, buf, len, IO_TRUNCATE))
+    ERROR_LOG("Can't save host stats to %s", stats_path);
+  free(buf);
+}
+
+void hoststats_free(void) {
+  pthread_mutex_lock(&stats_lock);
+  while(stats) {
+    struct host_stats *tmp = stats;
+    stats = stats->next;
+    free(tmp->host);
+    free(tmp);
+  }
+  pthread_mutex_unlock(&stats_lock);
+}
+
+void hoststats_add_connect(const char *host, double ms) {
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, true);
+  if(s->samples == 0) {
+    s->srtt_ms = ms;
+    s->rttvar_ms = ms / 2.0;
+  }
+  else {
+    double diff = s->srtt_ms - ms;
+    s->rttvar_ms = s->rttvar_ms * 3.0 / 4.0 + (diff < 0 ? -diff : diff) / 4.0;
+    s->srtt_ms = s->srtt_ms * 7.0 / 8.0 + ms / 8.0;
+  }
+  s->samples++;
+  s->last_seen = time(NULL);
+  pthread_mutex_unlock(&stats_lock);
+}
+
+// back off like tcp does, so one unlucky timeout doesn't make the host unreachable
+void hoststats_add_timeout(const char *host) {
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, false);
+  if(s && s->samples > 0) {
+    s->srtt_ms = clamp(s->srtt_ms * 2.0, 0.0, MAX_TIMEOUT_MS);
+    s->rttvar_ms = clamp(s->rttvar_ms * 2.0, 0.0, MAX_TIMEOUT_MS);
+    s->handshake_ms = clamp(s->handshake_ms * 2.0, 0.0, MAX_TIMEOUT_MS);
+  }
+  pthread_mutex_unlock(&stats_lock);
+}
+
+void hoststats_add_handshake(const char *host, double ms) {
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, true);
+  s->handshake_ms = ewma(s->handshake_ms, ms);
+  pthread_mutex_unlock(&stats_lock);
+}
+
+void hoststats_add_first_byte(const char *host, double ms) {
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, true);
+  s->first_byte_ms = ewma(s->first_byte_ms, ms);
+  pthread_mutex_unlock(&stats_lock);
+}
+
+// it takes longer than that, so it's waited for at least this long the next time (and then longer)
+void hoststats_add_first_byte_timeout(const char *host, double ms) {
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, true);
+  s->first_byte_ms = clamp(s->first_byte_ms * 2.0 > ms ? s->first_byte_ms * 2.0 : ms, 0.0, MAX_FIRST_BYTE_TIMEOUT_MS);
+  pthread_mutex_unlock(&stats_lock);
+}
+
+void hoststats_add_transfer(const char *host, size_t bytes, double ms) {
+  if(bytes == 0)
+    return;
+  if(ms < 0.001)
+    ms = 0.001;
+
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, true);
+  s->throughput = ewma(s->throughput, bytes / ms);
+  pthread_mutex_unlock(&stats_lock);
+}
+
+struct timeval hoststats_connect_timeout(const char *host) {
+  double ms = DEFAULT_TIMEOUT_MS;
+
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, false);
+  // rto = srtt + 4 * rttvar, with some room for a slower day
+  if(s && s->samples > 0)
+    ms = clamp(3.0 * (s->srtt_ms + 4.0 * s->rttvar_ms), MIN_CONNECT_TIMEOUT_MS, MAX_TIMEOUT_MS);
+  pthread_mutex_unlock(&stats_lock);
+
+  return ms_to_timeval(ms);
+}
+
+struct timeval hoststats_first_byte_timeout(const char *host) {
+  double ms = MIN_FIRST_BYTE_TIMEOUT_MS;
+
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, false);
+  // a page that usually takes its time to make may take a few times longer on a bad day
+  if(s && s->samples > 0)
+    ms = clamp(4.0 * (s->first_byte_ms + s->srtt_ms + 4.0 * s->rttvar_ms), MIN_FIRST_BYTE_TIMEOUT_MS, MAX_FIRST_BYTE_TIMEOUT_MS);
+  pthread_mutex_unlock(&stats_lock);
+
+  return ms_to_timeval(ms);
+}
+
+struct timeval hoststats_read_timeout(const char *host) {
+  double ms = DEFAULT_TIMEOUT_MS;
+
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, false);
+  // once the response is coming, the longest gap between two reads is about the handshake (a few round trips)
+  if(s && s->samples > 0)
+    ms = clamp(8.0 * (s->handshake_ms + s->srtt_ms + 4.0 * s->rttvar_ms), MIN_READ_TIMEOUT_MS, MAX_TIMEOUT_MS);
+  pthread_mutex_unlock(&stats_lock);
+
+  return ms_to_timeval(ms);
+}
+
+double hoststats_expected_ms(const char *host, size_t bytes) {
+  double ms = DEFAULT_TIMEOUT_MS;
+
+  pthread_mutex_lock(&stats_lock);
+  struct host_stats *s = find_host(host, false);
+  if(s && s->samples > 0) {
+    ms = s->srtt_ms + s->handshake_ms;
+    if(s->throughput > 0.0)
+      ms += bytes / s->throughput;
+  }
+  pthread_mutex_unlock(&stats_lock);
+
+  return ms;
+}
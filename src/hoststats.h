@@ -0,0 +1,44 @@
+#ifndef GEMINI_HOSTSTATS_H
+#define GEMINI_HOSTSTATS_H
+
+#include <stddef.h>
+#include <sys/time.h>
+
+// rolling per host:port latency statistics, persisted in the data dir
+// they're used for deriving connect/read deadlines instead of a fixed 5 seconds
+struct host_stats {
+  char *host;
+  // connect time, the same way tcp estimates the rtt (rfc 6298)
+  double srtt_ms, rttvar_ms;
+  double handshake_ms;
+  // from the request to the first byte of the response, it's mostly the server making the page
+  double first_byte_ms;
+  // bytes per ms
+  double throughput;
+  unsigned samples;
+  long last_seen;
+  struct host_stats *next;
+};
+
+void hoststats_load(void);
+void hoststats_save(void);
+void hoststats_free(void);
+
+void hoststats_add_connect(const char *host, double ms);
+// a connect, handshake or read ran out of time
+void hoststats_add_timeout(const char *host);
+void hoststats_add_handshake(const char *host, double ms);
+void hoststats_add_first_byte(const char *host, double ms);
+// no response came in ms
+void hoststats_add_first_byte_timeout(const char *host, double ms);
+void hoststats_add_transfer(const char *host, size_t bytes, double ms);
+
+struct timeval hoststats_connect_timeout(const char *host);
+// waiting for the first byte of the response, never less than the old 5 seconds
+struct timeval hoststats_first_byte_timeout(const char *host);
+// between two reads, after the first byte
+struct timeval hoststats_read_timeout(const char *host);
+// how long a fetch of that many bytes should take, the waiting revalidations of the cache go by it
+double hoststats_expected_ms(const char *host, size_t bytes);
+
+#endif
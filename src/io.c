@@ -0,0 +1,44 @@
+#include <errno.h>
+
+#include "io.h"
+#include "util.h"
+
+static int io_open(const char *path, enum io_write_mode mode) {
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+  flags |= (mode == IO_APPEND) ? O_APPEND : O_TRUNC;
+
+  int fd;
+  do {
+    fd = open(path, flags, 0666);
+  } while(fd == -1 && errno == EINTR);
+  return fd;
+}
+
+static long io_write_all(int fd, const char *buf, size_t size) {
+  size_t written = 0;
+  while(written < size) {
+    ssize_t n = write(fd, buf + written, size - written);
+    if(n == -1) {
+      if(errno == EINTR)
+        continue;
+      return -errno;
+    }
+    written += n;
+  }
+  return written;
+}
+
+int io_write_file(const char *path, const char *buf, size_t size, enum io_write_mode mode) {
+  int fd = io_open(path, mode);
+  if(fd == -1)
+    return 0;
+
+  long res = io_write_all(fd, buf, size);
+  if(close(fd) == -1 && res >= 0)
+    res = -errno;
+  if(res < 0) {
+    errno = -res;
+    return 0;
+  }
+  return 1;
+}
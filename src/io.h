@@ -0,0 +1,17 @@
+#ifndef GEMINI_IO_H
+#define GEMINI_IO_H
+
+#include <stddef.h>
+
+// the file writers go through here (saves, the host stats and the cache),
+// a file is opened, written until it's all there (short writes and EINTR are retried) and closed
+
+enum io_write_mode {
+  IO_TRUNCATE,
+  IO_APPEND,
+};
+
+// returns 1 on success, 0 on failure and sets errno
+int io_write_file(const char *path, const char *buf, size_t size, enum io_write_mode mode);
+
+#endif
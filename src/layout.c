@@ -0,0 +1,955 @@
+#include <ncurses.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "layout.h"
+#include "fetch.h"
+#include "utf8.h"
+#include "simd.h"
+#include "util.h"
+#include "pool.h"
+
+// nodes are measured (only counting their lines) in batches of this many
+#define MEASURE_BATCH 256
+// and this much of the body at once in idle time
+#define STEP_BYTES (4 * 1024 * 1024)
+// or this many nodes, if the body is already parsed (for a layout of another width)
+#define STEP_NODES (64 * 1024)
+// less nodes than that aren't worth splitting between threads
+#define PARALLEL_MIN_NODES 8192
+#define CHUNKS_PER_THREAD 4
+// layouts for other widths kept per page, so resizing back and forth is free
+#define LAYOUT_CACHE_SIZE 4
+
+// the rest of a page is measured on its own thread, which takes it only to move the arrays
+// (and the nodes) and to publish what it measured, the ui takes it to read them
+static pthread_mutex_t layout_lock = PTHREAD_MUTEX_INITIALIZER;
+
+enum layout_kind {
+  LAYOUT_NONE,
+  LAYOUT_DOC,
+  LAYOUT_LINKS,
+};
+
+// nodes of one kind (links, headings) in the order they're on the page, 
+// so they're found without going through the lines, only the published num of them can be read
+struct node_index {
+  int *nodes;
+  int num, cap;
+};
+
+struct page_layout {
+  enum layout_kind kind;
+  int width;
+  // lines, their texts and links
+  struct arena arena;
+  // the page's document, or a list of links with one node per link
+  struct gemtext_doc *doc;
+  char **links;
+  int links_num;
+  // first_line[i] is the first line of node i, it's known up to measured_num
+  // (first_line[measured_num] is the number of lines so far)
+  int *first_line;
+  int measured_num, measured_cap;
+  // published by the one who measures, under layout_lock
+  int lines_num;
+  bool is_done;
+  // where the measured part ends in the body, and its size before the worker
+  // (it may move the end to a '\0')
+  size_t measured_bytes, body_size;
+  // the background worker, it's the only one who measures while it runs
+  pthread_t worker;
+  bool has_worker;
+  atomic_bool cancel, is_finished;
+  // of the measured nodes
+  struct node_index link_nodes, heading_nodes;
+  // the lines of every node, laid out when one of them is shown for the first time
+  struct screen_line **node_lines;
+  // the node of the last asked line, they're mostly asked one after another
+  int last_node;
+  // layouts of the same page for other widths, the least recently used one last
+  struct page_layout *next;
+};
+
+// one paragraph goes into lines, or if there's nowhere to put them, they're only counted
+struct wrap {
+  struct arena *arena;
+  struct screen_line *lines;
+  int lines_num;
+  int width;
+  unsigned int attr;
+  char *link;
+  bool is_preformatted;
+};
+
+static const char *protocols_strings[] = {
+  [HTTPS] = " [https]",
+  [HTTP] = " [http]",
+  [GOPHER] = " [gopher]",
+  [MAIL] = " [mail]",
+  [FINGER] = " [finger]",
+  [SPARTAN] = " [spartan]",
+};
+
+// lines are only made for what's shown, so it's decoded only for that
+static void decode_line(struct arena *arena, struct screen_line *line, int len) {
+  line->wide = NULL;
+  line->len = len;
+  if(simd_ascii_printable_len(line->text, len) == (size_t)len)
+    return;
+
+  // a character per byte at most
+  line->wide = arena_alloc(arena, len * sizeof(wchar_t));
+  const char *p = line->text, *end = line->text + len;
+  int n = 0;
+  while(p < end) {
+    uint32_t cp;
+    p += utf8_decode(p, &cp);
+    line->wide[n++] = cp;
+  }
+  line->len = n;
+}
+
+static void add_line(struct wrap *w, const char *text, int len) {
+  if(w->lines) {
+    struct screen_line *line = &w->lines[w->lines_num];
+    line->text = arena_strndup(w->arena, text, len);
+    line->link = w->link;
+    line->attr = w->attr;
+    decode_line(w->arena, line, len);
+  }
+  w->lines_num++;
+}
+
+// the wrapped line doesn't start with the whitespace it was broken at
+static const char *wrapped_line_start(const struct wrap *w, const char *start, const char *end) {
+  uint32_t cp;
+  int char_bytes = utf8_decode(start, &cp);
+  if(start < end && !w->is_preformatted && utf8_cp_is_space(cp))
+    start += char_bytes;
+  return start;
+}
+
+static void add_wrapped_line(struct wrap *w, const char *start, const char *end) {
+  start = wrapped_line_start(w, start, end);
+  add_line(w, start, end - start);
+}
+
+// wraps one paragraph in a single pass, every codepoint is measured once
+// every wrapped line shares the same link pointer
+static void layout_paragraph(struct wrap *w, const char *str, int len) {
+  const char *end = str + len;
+  const char *line_start = str, *p = str;
+  // the last whitespace on the line, where it can be broken
+  const char *last_break = NULL;
+  // widths from the line start, up to p and up to last_break
+  int line_width = 0, break_width = 0;
+
+  while(p < end) {
+    // printable ascii is one column per byte, so a run of it is taken at once without decoding
+    if(line_width < w->width && (unsigned char)*p >= 0x20 && (unsigned char)*p < 0x7F) {
+      size_t room = w->width - line_width;
+      size_t run = simd_ascii_printable_len(p, (size_t)(end - p) < room ? (size_t)(end - p) : room);
+      long space = simd_last_byte(p, run, ' ');
+      if(space > 0 || (space == 0 && p != line_start)) {
+        last_break = p + space;
+        break_width = line_width + space;
+      }
+      line_width += run;
+      p += run;
+      continue;
+    }
+
+    uint32_t cp;
+    int char_bytes = utf8_decode(p, &cp);
+    int char_width = utf8_cp_drawn_width(cp, line_width);
+    bool is_space = utf8_cp_is_space(cp);
+
+    if(line_width + char_width <= w->width) {
+      if(is_space && p != line_start) {
+        last_break = p;
+        break_width = line_width;
+      }
+      line_width += char_width;
+      p += char_bytes;
+      continue;
+    }
+
+    // a character wider than the whole line, take it anyway
+    if(p == line_start) {
+      p += char_bytes;
+      add_wrapped_line(w, line_start, p);
+      line_start = p;
+      line_width = 0;
+      last_break = NULL;
+      continue;
+    }
+
+    // the line is full, break it at p if it's a whitespace, 
+    // otherwise move the last word to the next line, 
+    // unless it's a long one (more than half of the width), then let it be split
+    const char *line_end = p;
+    int carried_width = 0;
+    if(!is_space && last_break != NULL && line_width - break_width <= w->width / 2) {
+      line_end = last_break;
+      // a tab is as wide as it is far from the next tab stop, so it's measured again where it goes
+      const char *carried = wrapped_line_start(w, line_end, p);
+      if(simd_ascii_printable_len(carried, p - carried) == (size_t)(p - carried))
+        carried_width = p - carried;
+      else
+        carried_width = utf8_span_drawn_width(carried, p - carried, 0);
+    }
+
+    add_wrapped_line(w, line_start, line_end);
+    line_start = line_end;
+    line_width = carried_width;
+    last_break = NULL;
+  }
+
+  // the rest (or an empty paragraph)
+  if(line_start < end || line_start == str)
+    add_wrapped_line(w, line_start, end);
+}
+
+static unsigned int node_attr(const struct gemtext_node *node) {
+  switch(node->type) {
+    case GEMTEXT_HEADING:
+      if(node->level == 1)
+        return A_BOLD | COLOR_PAIR(H1_COLOR);
+      return A_BOLD | A_ITALIC | COLOR_PAIR(node->level == 2 ? H2_COLOR : H3_COLOR);
+    case GEMTEXT_QUOTE:
+      return A_ITALIC | COLOR_PAIR(QUOTE_COLOR);
+    case GEMTEXT_LINK:
+      return A_UNDERLINE | COLOR_PAIR(LINK_COLOR);
+    default:
+      return A_NORMAL;
+  }
+}
+
+static void layout_link(struct wrap *w, const struct gemtext_doc *doc, const struct gemtext_node *node) {
+  const char *url = gemtext_ptr(doc, node->url);
+  const char *text = gemtext_ptr(doc, node->text);
+
+  if(w->lines && node->url.len > 0)
+    w->link = arena_strndup(w->arena, url, node->url.len);
+
+  // it's a link to a page we can't show by ourselves, so say what it is
+  // (a link without a label shows the plain url, which says it already)
+  enum protocols protocol = get_protocol(url);
+  if(node->text.offset != node->url.offset && protocol != null && !fetch_is_native(protocol)) {
+    const char *protocol_str = protocols_strings[protocol];
+    size_t protocol_len = strlen(protocol_str);
+    size_t label_len = node->text.len + protocol_len;
+    // lines copy their text, so the label is only needed for a moment
+    char small_label[256];
+    char *label = label_len < sizeof(small_label) ? small_label : malloc(label_len + 1);
+    if(label == NULL)
+      MALLOC_ERROR;
+    memcpy(label, text, node->text.len);
+    memcpy(label + node->text.len, protocol_str, protocol_len + 1);
+
+    layout_paragraph(w, label, label_len);
+    if(label != small_label)
+      free(label);
+    return;
+  }
+
+  layout_paragraph(w, text, node->text.len);
+}
+
+// lays out node i into lines, or only counts them if lines is NULL
+static int layout_node(struct page_layout *l, int i, struct screen_line *lines) {
+  struct wrap w = { .arena = &l->arena, .lines = lines, .width = l->width };
+
+  if(l->kind == LAYOUT_LINKS) {
+    const char *link = l->links[i];
+    w.link = l->links[i];
+    layout_paragraph(&w, link, strlen(link));
+
+    // the domain is bolded, so everything up to the first slash
+    for(int j = 0; lines && j < w.lines_num; j++) {
+      lines[j].attr = A_BOLD;
+      if(strchr(lines[j].text, '/'))
+        break;
+    }
+    return w.lines_num;
+  }
+
+  const struct gemtext_doc *doc = l->doc;
+  const struct gemtext_node *node = &doc->nodes[i];
+  w.attr = node_attr(node);
+  switch(node->type) {
+    case GEMTEXT_LINK:
+      layout_link(&w, doc, node);
+      break;
+    case GEMTEXT_HEADING:
+    case GEMTEXT_QUOTE:
+      layout_paragraph(&w, gemtext_ptr(doc, node->text), node->text.len);
+      break;
+    // shown as they're written
+    case GEMTEXT_PRE_TOGGLE:
+    case GEMTEXT_PRE:
+      w.is_preformatted = true;
+      layout_paragraph(&w, gemtext_ptr(doc, node->line), node->line.len);
+      break;
+    case GEMTEXT_TEXT:
+    case GEMTEXT_LIST_ITEM:
+      layout_paragraph(&w, gemtext_ptr(doc, node->line), node->line.len);
+      break;
+  }
+  return w.lines_num;
+}
+
+static int nodes_num(const struct page_layout *l) {
+  return l->kind == LAYOUT_LINKS ? l->links_num : l->doc->nodes_num;
+}
+
+// "=>" without an url isn't a link on the screen
+static bool is_link(const struct page_layout *l, int i) {
+  if(l->kind == LAYOUT_LINKS)
+    return true;
+  const struct gemtext_node *node = &l->doc->nodes[i];
+  return node->type == GEMTEXT_LINK && node->url.len > 0;
+}
+
+static bool is_measured(const struct page_layout *l) {
+  if(l->kind == LAYOUT_DOC && !gemtext_is_parsed(l->doc))
+    return false;
+  return l->measured_num == nodes_num(l);
+}
+
+// a range of nodes measured on its own, first_line of it is counted from 0 first
+struct measure_chunk {
+  struct page_layout *layout;
+  int start, end;
+  int first_line;
+};
+
+static void measure_task(void *arg, int task) {
+  struct measure_chunk *c = (struct measure_chunk*)arg + task;
+  struct page_layout *l = c->layout;
+
+  int lines_num = 0;
+  for(int i = c->start; i < c->end; i++) {
+    lines_num += layout_node(l, i, NULL);
+    l->first_line[i + 1] = lines_num;
+  }
+}
+
+static void add_first_line_task(void *arg, int task) {
+  struct measure_chunk *c = (struct measure_chunk*)arg + task;
+  for(int i = c->start; i < c->end; i++)
+    c->layout->first_line[i + 1] += c->first_line;
+}
+
+// a big range is split between the pool's threads and stitched together afterwards,
+// nodes don't depend on each other, the preformatted blocks are known from the parsing
+static void measure_parallel(struct page_layout *l, int end) {
+  int chunks_num = pool_threads() * CHUNKS_PER_THREAD;
+  struct measure_chunk chunks[chunks_num];
+  int start = l->measured_num, nodes_num = end - start;
+
+  for(int i = 0; i < chunks_num; i++) {
+    chunks[i] = (struct measure_chunk) { 
+      .layout = l, 
+      .start = start + (long)nodes_num * i / chunks_num,
+      .end = start + (long)nodes_num * (i + 1) / chunks_num,
+    };
+  }
+  pool_run(measure_task, chunks, chunks_num);
+
+  int first_line = l->first_line[start];
+  for(int i = 0; i < chunks_num; i++) {
+    chunks[i].first_line = first_line;
+    if(chunks[i].end > chunks[i].start)
+      first_line += l->first_line[chunks[i].end];
+  }
+  pool_run(add_first_line_task, chunks, chunks_num);
+}
+
+// num is the one not published yet
+static void index_add(struct node_index *index, int *num, int node) {
+  if(*num == index->cap) {
+    int cap = index->cap ? index->cap * 2 : 64;
+    pthread_mutex_lock(&layout_lock);
+    index->nodes = realloc(index->nodes, cap * sizeof(int));
+    if(index->nodes == NULL)
+      MALLOC_ERROR;
+    index->cap = cap;
+    pthread_mutex_unlock(&layout_lock);
+  }
+  index->nodes[(*num)++] = node;
+}
+
+// counts the lines of the nodes up to end, they have to be parsed
+static void measure_nodes(struct page_layout *l, int end) {
+  if(end >= l->measured_cap) {
+    int cap = l->measured_cap ? l->measured_cap : 256;
+    while(cap <= end)
+      cap *= 2;
+
+    pthread_mutex_lock(&layout_lock);
+    l->first_line = realloc(l->first_line, cap * sizeof(int));
+    l->node_lines = realloc(l->node_lines, cap * sizeof(struct screen_line*));
+    if(l->first_line == NULL || l->node_lines == NULL)
+      MALLOC_ERROR;
+    memset(&l->node_lines[l->measured_cap], 0, (cap - l->measured_cap) * sizeof(struct screen_line*));
+    l->measured_cap = cap;
+    pthread_mutex_unlock(&layout_lock);
+  }
+
+  // nobody reads after measured_num, so it's done without the lock
+  if(pool_threads() > 1 && end - l->measured_num >= PARALLEL_MIN_NODES) {
+    measure_parallel(l, end);
+  }
+  else {
+    for(int i = l->measured_num; i < end; i++)
+      l->first_line[i + 1] = l->first_line[i] + layout_node(l, i, NULL);
+  }
+
+  int links_num = l->link_nodes.num, headings_num = l->heading_nodes.num;
+  for(int i = l->measured_num; i < end; i++) {
+    if(is_link(l, i))
+      index_add(&l->link_nodes, &links_num, i);
+    else if(l->kind == LAYOUT_DOC && l->doc->nodes[i].type == GEMTEXT_HEADING)
+      index_add(&l->heading_nodes, &headings_num, i);
+  }
+
+  size_t measured_bytes = 0;
+  if(l->kind == LAYOUT_DOC && end > 0) {
+    const struct gemtext_node *last = &l->doc->nodes[end - 1];
+    measured_bytes = last->line.offset + last->line.len + 1;
+  }
+
+  pthread_mutex_lock(&layout_lock);
+  l->measured_num = end;
+  l->lines_num = l->first_line[end];
+  l->link_nodes.num = links_num;
+  l->heading_nodes.num = headings_num;
+  l->measured_bytes = measured_bytes;
+  l->is_done = is_measured(l);
+  pthread_mutex_unlock(&layout_lock);
+}
+
+// counts the lines of the next n nodes (parsing them first if they're not)
+static void measure(struct page_layout *l, int n) {
+  int end = l->measured_num + n;
+
+  if(l->kind == LAYOUT_DOC && gemtext_parse_more(l->doc, end) == -1)
+    MALLOC_ERROR;
+  if(end > nodes_num(l))
+    end = nodes_num(l);
+
+  measure_nodes(l, end);
+}
+
+// a slice of the rest of the page, returns true if there's more
+static bool step(struct page_layout *l) {
+  if(l->is_done)
+    return false;
+
+  if(l->kind == LAYOUT_DOC && l->measured_num == l->doc->nodes_num) {
+    if(gemtext_parse_bytes(l->doc, STEP_BYTES) == -1)
+      MALLOC_ERROR;
+  }
+  
+  int end = nodes_num(l);
+  if(end - l->measured_num > STEP_NODES)
+    end = l->measured_num + STEP_NODES;
+  measure_nodes(l, end);
+  return !l->is_done;
+}
+
+static void *layout_worker(void *arg) {
+  struct page_layout *l = arg;
+  while(!atomic_load(&l->cancel) && step(l))
+    ;
+  atomic_store(&l->is_finished, true);
+  return NULL;
+}
+
+static void start_worker(struct page_layout *l) {
+  atomic_store(&l->cancel, false);
+  atomic_store(&l->is_finished, false);
+  if(pthread_create(&l->worker, NULL, layout_worker, l) != 0) {
+    // then it's measured as it's scrolled
+    ERROR_LOG("layout: can't create the worker thread");
+    return;
+  }
+  l->has_worker = true;
+}
+
+// it stops after the slice it's working on, everything up to it stays measured
+static void stop_worker(struct page_layout *l) {
+  if(!l->has_worker)
+    return;
+  atomic_store(&l->cancel, true);
+  pthread_join(l->worker, NULL);
+  l->has_worker = false;
+}
+
+static void layout_init(struct page_t *page, struct page_layout *l, enum layout_kind kind, int width) {
+  l->kind = kind;
+  l->width = width;
+  // there's always first_line[measured_num]
+  l->measured_cap = 1;
+  l->first_line = malloc(sizeof(int));
+  l->node_lines = calloc(1, sizeof(struct screen_line*));
+  if(l->first_line == NULL || l->node_lines == NULL)
+    MALLOC_ERROR;
+  l->first_line[0] = 0;
+
+  page->lines_num = 0;
+}
+
+static struct page_layout *layout_start(struct page_t *page, enum layout_kind kind, int width) {
+  if(page->layout == NULL) {
+    page->layout = calloc(1, sizeof(struct page_layout));
+    if(page->layout == NULL)
+      MALLOC_ERROR;
+  }
+  else {
+    layout_free(page);
+  }
+
+  layout_init(page, page->layout, kind, width);
+  page->selected_link_index = -1;
+  return page->layout;
+}
+
+static void layout_release(struct page_layout *l) {
+  if(l->kind == LAYOUT_NONE)
+    return;
+  stop_worker(l);
+
+  INFO_LOG(
+      "layout: %d lines of %d nodes (width %d), %zu allocations in %zu arena blocks (%zu KiB)", 
+      l->lines_num,
+      l->measured_num,
+      l->width,
+      l->arena.allocs, 
+      l->arena.blocks_num, 
+      l->arena.used / 1024
+  );
+
+  free(l->first_line);
+  free(l->node_lines);
+  free(l->link_nodes.nodes);
+  free(l->heading_nodes.nodes);
+  arena_release(&l->arena);
+
+  struct arena arena = l->arena;
+  struct page_layout *next = l->next;
+  memset(l, 0, sizeof(*l));
+  l->arena = arena;
+  l->next = next;
+}
+
+static void layout_destroy_one(struct page_layout *l) {
+  layout_release(l);
+  arena_free(&l->arena);
+  free(l);
+}
+
+void layout_gemtext(struct page_t *page, int width) {
+  struct page_layout *l = layout_start(page, LAYOUT_DOC, width);
+  l->doc = &page->doc;
+  l->body_size = page->doc.end - page->doc.body;
+  // the worker may move the nodes while they're read
+  page->doc.lock = &layout_lock;
+  // so an empty page is known right away
+  measure(l, 1);
+  page->lines_num = l->lines_num;
+}
+
+void layout_links(struct page_t *page, char **links, int links_num, int width) {
+  struct page_layout *l = layout_start(page, LAYOUT_LINKS, width);
+  l->links_num = links_num;
+
+  // the list can change under us, so it's copied
+  l->links = arena_alloc(&l->arena, links_num * sizeof(char*));
+  for(int i = 0; i < links_num; i++)
+    l->links[i] = arena_strndup(&l->arena, links[i], strlen(links[i]));
+
+  // there's only a few of them, so they're measured right away
+  measure(l, links_num);
+  page->lines_num = l->lines_num;
+}
+
+void layout_free(struct page_t *page) {
+  struct page_layout *l = page->layout;
+  page->lines_num = 0;
+  if(l == NULL)
+    return;
+
+  // the cached ones are for the old page
+  while(l->next) {
+    struct page_layout *next = l->next->next;
+    layout_destroy_one(l->next);
+    l->next = next;
+  }
+  layout_release(l);
+}
+
+void layout_destroy(struct page_t *page) {
+  layout_free(page);
+  if(page->layout)
+    layout_destroy_one(page->layout);
+  page->layout = NULL;
+}
+
+void layout_move(struct page_t *to, struct page_t *from) {
+  for(struct page_layout *l = from->layout; l; l = l->next) {
+    // what it measured stays, layout_poll starts it again
+    stop_worker(l);
+    if(l->doc == &from->doc)
+      l->doc = &to->doc;
+  }
+  *to = *from;
+  memset(from, 0, sizeof(*from));
+}
+
+size_t layout_memory(const struct page_t *page) {
+  size_t size = 0;
+  for(const struct page_layout *l = page->layout; l; l = l->next) {
+    size += sizeof(*l) + l->arena.used;
+    size += l->measured_cap * (sizeof(int) + sizeof(struct screen_line*));
+    size += (l->link_nodes.cap + l->heading_nodes.cap) * sizeof(int);
+  }
+  return size;
+}
+
+bool page_has_lines(const struct page_t *page) {
+  return page->layout && page->layout->kind != LAYOUT_NONE && page->lines_num > 0;
+}
+
+int layout_ensure_lines(struct page_t *page, int n) {
+  struct page_layout *l = page->layout;
+  if(l == NULL)
+    return 0;
+
+  // the worker is on it, so there's only what it has done so far
+  if(!l->has_worker) {
+    while(l->lines_num < n && !l->is_done)
+      measure(l, MEASURE_BATCH);
+  }
+
+  pthread_mutex_lock(&layout_lock);
+  page->lines_num = l->lines_num;
+  pthread_mutex_unlock(&layout_lock);
+  return page->lines_num;
+}
+
+bool layout_is_done(const struct page_t *page) {
+  const struct page_layout *l = page->layout;
+  if(l == NULL || l->kind == LAYOUT_NONE)
+    return true;
+
+  pthread_mutex_lock(&layout_lock);
+  bool is_done = l->is_done;
+  pthread_mutex_unlock(&layout_lock);
+  return is_done;
+}
+
+bool layout_step(struct page_t *page) {
+  struct page_layout *l = page->layout;
+  if(l == NULL || l->kind == LAYOUT_NONE)
+    return false;
+
+  assert(!l->has_worker);
+  bool more = step(l);
+  page->lines_num = l->lines_num;
+  return more;
+}
+
+bool layout_poll(struct page_t *page, int *percent) {
+  struct page_layout *l = page->layout;
+  if(l == NULL || l->kind == LAYOUT_NONE)
+    return false;
+
+  if(l->has_worker && atomic_load(&l->is_finished)) {
+    pthread_join(l->worker, NULL);
+    l->has_worker = false;
+  }
+
+  if(!l->has_worker && !l->is_done) {
+    // the rest of a small page isn't worth a thread
+    if(l->body_size - l->measured_bytes <= STEP_BYTES) {
+      while(step(l))
+        ;
+    }
+    else {
+      start_worker(l);
+    }
+  }
+
+  pthread_mutex_lock(&layout_lock);
+  page->lines_num = l->lines_num;
+  bool is_done = l->is_done;
+  if(percent)
+    *percent = l->body_size ? l->measured_bytes * 100 / l->body_size : 100;
+  pthread_mutex_unlock(&layout_lock);
+  return !is_done;
+}
+
+int layout_lines_estimate(const struct page_t *page) {
+  const struct page_layout *l = page->layout;
+  if(l == NULL || l->kind == LAYOUT_NONE)
+    return page->lines_num;
+
+  pthread_mutex_lock(&layout_lock);
+  int lines_num = l->lines_num;
+  // the rest of the body probably wraps like the part so far
+  if(!l->is_done && l->measured_bytes > 0)
+    lines_num = (int)(lines_num * ((double)l->body_size / l->measured_bytes));
+  pthread_mutex_unlock(&layout_lock);
+  return lines_num;
+}
+
+static int line_node(struct page_layout *l, int i) {
+  int n = l->last_node;
+  if(n < l->measured_num && i >= l->first_line[n] && i < l->first_line[n + 1])
+    return n;
+
+  if(n + 1 < l->measured_num && i >= l->first_line[n + 1] && i < l->first_line[n + 2]) {
+    n++;
+  }
+  else {
+    // every node has at least one line, so the first lines only go up
+    int lo = 0, hi = l->measured_num - 1;
+    while(lo < hi) {
+      int mid = lo + (hi - lo + 1) / 2;
+      if(l->first_line[mid] <= i)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    n = lo;
+  }
+  l->last_node = n;
+  return n;
+}
+
+struct screen_line *page_line(struct page_t *page, int i) {
+  struct page_layout *l = page->layout;
+  assert(i >= 0 && i < page->lines_num);
+
+  // the worker may be moving the arrays
+  pthread_mutex_lock(&layout_lock);
+  int n = line_node(l, i);
+  if(l->node_lines[n] == NULL) {
+    int lines_num = l->first_line[n + 1] - l->first_line[n];
+    l->node_lines[n] = arena_alloc(&l->arena, lines_num * sizeof(struct screen_line));
+    layout_node(l, n, l->node_lines[n]);
+  }
+  struct screen_line *line = &l->node_lines[n][i - l->first_line[n]];
+  pthread_mutex_unlock(&layout_lock);
+  return line;
+}
+
+static int index_num(const struct node_index *index) {
+  pthread_mutex_lock(&layout_lock);
+  int num = index->num;
+  pthread_mutex_unlock(&layout_lock);
+  return num;
+}
+
+static int index_line(const struct page_t *page, const struct node_index *index, int k) {
+  pthread_mutex_lock(&layout_lock);
+  assert(k >= 0 && k < index->num);
+  int line = page->layout->first_line[index->nodes[k]];
+  pthread_mutex_unlock(&layout_lock);
+  return line;
+}
+
+// the nodes are in the order of their lines
+static int index_from(const struct page_t *page, const struct node_index *index, int i) {
+  pthread_mutex_lock(&layout_lock);
+  // the worker may move it
+  const int *first_line = page->layout->first_line;
+  int lo = 0, hi = index->num;
+  while(lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if(first_line[index->nodes[mid]] < i)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  pthread_mutex_unlock(&layout_lock);
+  return lo;
+}
+
+static bool has_index(const struct page_t *page) {
+  return page->layout && page->layout->kind != LAYOUT_NONE;
+}
+
+int layout_links_num(const struct page_t *page) {
+  return has_index(page) ? index_num(&page->layout->link_nodes) : 0;
+}
+
+int layout_link_line(const struct page_t *page, int link) {
+  return index_line(page, &page->layout->link_nodes, link);
+}
+
+int layout_link_from(const struct page_t *page, int i) {
+  return has_index(page) ? index_from(page, &page->layout->link_nodes, i) : 0;
+}
+
+int layout_headings_num(const struct page_t *page) {
+  return has_index(page) ? index_num(&page->layout->heading_nodes) : 0;
+}
+
+int layout_heading_line(const struct page_t *page, int heading) {
+  return index_line(page, &page->layout->heading_nodes, heading);
+}
+
+int layout_heading_from(const struct page_t *page, int i) {
+  return has_index(page) ? index_from(page, &page->layout->heading_nodes, i) : 0;
+}
+
+void layout_heading(const struct page_t *page, int heading, struct layout_heading *h) {
+  const struct page_layout *l = page->layout;
+  pthread_mutex_lock(&layout_lock);
+  assert(heading >= 0 && heading < l->heading_nodes.num);
+  int n = l->heading_nodes.nodes[heading];
+  const struct gemtext_node *node = &l->doc->nodes[n];
+  h->line = l->first_line[n];
+  h->level = node->level;
+  h->text = gemtext_ptr(l->doc, node->text);
+  h->len = node->text.len;
+  pthread_mutex_unlock(&layout_lock);
+}
+
+int layout_offset_line(struct page_t *page, size_t offset, int *lines_num) {
+  struct page_layout *l = page->layout;
+  if(l == NULL || l->kind != LAYOUT_DOC)
+    return -1;
+
+  if(!l->has_worker) {
+    while(!l->is_done && l->measured_bytes <= offset)
+      measure(l, MEASURE_BATCH);
+  }
+
+  pthread_mutex_lock(&layout_lock);
+  page->lines_num = l->lines_num;
+  if(offset >= l->measured_bytes) {
+    pthread_mutex_unlock(&layout_lock);
+    return -1;
+  }
+
+  // the last node that starts before it
+  const struct gemtext_node *nodes = l->doc->nodes;
+  int lo = 0, hi = l->measured_num - 1;
+  while(lo < hi) {
+    int mid = lo + (hi - lo + 1) / 2;
+    if(nodes[mid].line.offset <= offset)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  int line = l->first_line[lo];
+  *lines_num = l->first_line[lo + 1] - line;
+  pthread_mutex_unlock(&layout_lock);
+  return line;
+}
+
+size_t layout_line_offset(struct page_t *page, int i) {
+  struct page_layout *l = page->layout;
+  if(l == NULL || l->kind != LAYOUT_DOC || i >= page->lines_num)
+    return 0;
+
+  pthread_mutex_lock(&layout_lock);
+  size_t offset = l->doc->nodes[line_node(l, i)].line.offset;
+  pthread_mutex_unlock(&layout_lock);
+  return offset;
+}
+
+// the line at the same place of the node in the other layout, neither of them has a worker
+static int remap_line(struct page_t *page, struct page_layout *from, int i) {
+  if(i >= from->lines_num)
+    i = from->lines_num - 1;
+  int n = line_node(from, i);
+  int offset = i - from->first_line[n];
+  int from_lines = from->first_line[n + 1] - from->first_line[n];
+
+  struct page_layout *l = page->layout;
+  if(l->measured_num <= n && !l->is_done)
+    measure(l, n + 1 - l->measured_num);
+  page->lines_num = l->lines_num;
+  if(n >= l->measured_num)
+    return page->lines_num - 1;
+
+  int lines = l->first_line[n + 1] - l->first_line[n];
+  return l->first_line[n] + (offset * lines + from_lines / 2) / from_lines;
+}
+
+void layout_resize(struct page_t *page, int width) {
+  struct page_layout *old = page->layout;
+  if(old == NULL || old->kind == LAYOUT_NONE || old->width == width)
+    return;
+
+  // it's for the old width, what it measured is kept for later
+  stop_worker(old);
+
+  // it's highlighted in the old lines, which may be shown again later
+  if(page->selected_link_index != -1)
+    page_line(page, page->selected_link_index)->attr &= ~A_STANDOUT;
+
+  // the layout for this width may be still there
+  struct page_layout **prev = &old->next, *l = old->next;
+  int cached_num = 1;
+  while(l && l->width != width) {
+    prev = &l->next;
+    l = l->next;
+    cached_num++;
+  }
+
+  bool is_cached = l != NULL;
+  if(is_cached) {
+    *prev = l->next;
+  }
+  else {
+    // the least recently used one goes away and its memory is reused
+    if(cached_num >= LAYOUT_CACHE_SIZE) {
+      prev = &old->next;
+      while((*prev)->next)
+        prev = &(*prev)->next;
+      l = *prev;
+      *prev = NULL;
+      layout_release(l);
+    }
+    else {
+      l = calloc(1, sizeof(struct page_layout));
+      if(l == NULL)
+        MALLOC_ERROR;
+    }
+
+    layout_init(page, l, old->kind, width);
+    l->doc = old->doc;
+    l->body_size = old->body_size;
+    l->links_num = old->links_num;
+    if(old->links) {
+      l->links = arena_alloc(&l->arena, old->links_num * sizeof(char*));
+      for(int i = 0; i < old->links_num; i++)
+        l->links[i] = arena_strndup(&l->arena, old->links[i], strlen(old->links[i]));
+    }
+  }
+
+  l->next = old;
+  page->layout = l;
+  page->lines_num = l->lines_num;
+  INFO_LOG("layout: width %d -> %d (%s)", old->width, width, is_cached ? "cached" : "new");
+
+  // the screen stays on the same paragraph
+  if(l->lines_num == 0)
+    measure(l, l->kind == LAYOUT_LINKS ? l->links_num : 1);
+  if(old->lines_num > 0) {
+    page->first_line_index = remap_line(page, old, page->first_line_index);
+    if(page->selected_link_index != -1) {
+      int n = line_node(old, page->selected_link_index);
+      page->selected_link_index = remap_line(page, old, old->first_line[n]);
+      page_line(page, page->selected_link_index)->attr |= A_STANDOUT;
+    }
+  }
+  page->lines_num = l->lines_num;
+}
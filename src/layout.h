@@ -0,0 +1,79 @@
+#ifndef GEMINI_LAYOUT_H
+#define GEMINI_LAYOUT_H
+
+#include "page.h"
+#include "gemtext.h"
+
+// turns a parsed page into screen lines for the given width (in columns)
+// it's the only width dependent part, so a resize doesn't need parsing again
+//
+// nothing is wrapped up front, the paragraphs are measured (their lines counted) 
+// as far as the page is scrolled, and a paragraph is laid out when one of its lines is shown,
+// so the first screen of a huge page doesn't wait for all of it,
+// the rest of a big page is measured on a worker thread while the first part is shown
+
+enum color {LINK_COLOR = 1, H1_COLOR = 2, H2_COLOR = 3, H3_COLOR = 4, QUOTE_COLOR = 5, DIALOG_COLOR = 6, SEARCH_COLOR = 7};
+
+// page->doc (it can be only initialized, it's parsed as it's needed)
+void layout_gemtext(struct page_t *page, int width);
+// every string is a link on its own (bookmarks, saved files), the domain is bolded
+void layout_links(struct page_t *page, char **links, int links_num, int width);
+// the lines (and the layouts for other widths) are gone, the memory is kept for the next layout
+void layout_free(struct page_t *page);
+void layout_destroy(struct page_t *page);
+// switches to the layout for the new width (a cached one if it's there), 
+// the first line and the selected link are moved to the same paragraph
+void layout_resize(struct page_t *page, int width);
+bool page_has_lines(const struct page_t *page);
+// the page goes to another page_t with all of its layouts (the history keeps it so), from is empty then,
+// the worker stops and the next layout_poll starts it again
+void layout_move(struct page_t *to, struct page_t *from);
+// what the layouts of the page take, about
+size_t layout_memory(const struct page_t *page);
+
+// measures paragraphs until there are at least n lines (or the page ends), returns page->lines_num,
+// while the worker runs, there's only as many lines as it has measured
+int layout_ensure_lines(struct page_t *page, int n);
+bool layout_is_done(const struct page_t *page);
+// a slice of the remaining measuring on this thread, returns true if there's more to do
+// (there can't be a worker, it's for benchmarks)
+bool layout_step(struct page_t *page);
+// starts the worker for the rest of the page (or finishes a small rest right away), 
+// picks up what it has measured so far and its progress in percent of the body,
+// returns true while it's still running
+bool layout_poll(struct page_t *page, int *percent);
+// the number of lines of the whole page, extrapolated until it's measured
+int layout_lines_estimate(const struct page_t *page);
+
+// links are numbered from 0 in the order they're on the page, only the measured ones are known,
+// a link wrapped into more lines is found by its first one
+int layout_links_num(const struct page_t *page);
+int layout_link_line(const struct page_t *page, int link);
+// the first link on the line i or after it, layout_links_num if there's none
+int layout_link_from(const struct page_t *page, int i);
+
+// the same for the headings, an outline of the page
+struct layout_heading {
+  int line;
+  // 1-3
+  int level;
+  // in the body, not terminated
+  const char *text;
+  size_t len;
+};
+
+int layout_headings_num(const struct page_t *page);
+int layout_heading_line(const struct page_t *page, int heading);
+int layout_heading_from(const struct page_t *page, int i);
+void layout_heading(const struct page_t *page, int heading, struct layout_heading *h);
+
+// the first line of the paragraph with the byte at offset of the body, and the number of its lines,
+// it's measured as far as it has to be, -1 if the worker hasn't got there yet
+int layout_offset_line(struct page_t *page, size_t offset, int *lines_num);
+// where the paragraph of line i starts in the body
+size_t layout_line_offset(struct page_t *page, int i);
+
+// i has to be < page->lines_num, the pointer is valid until the layout is freed
+struct screen_line *page_line(struct page_t *page, int i);
+
+#endif
@@ -0,0 +1,261 @@
+#include <string.h>
+#include <ctype.h>
+
+#include "lineedit.h"
+#include "utf8.h"
+#include "util.h"
+
+// columns for the text, up to the end of the window
+static int text_width(const struct lineedit *e) {
+  return getmaxx(e->win) - e->text_x;
+}
+
+static int span_width(const struct lineedit *e, int from, int to) {
+  return utf8_span_width(e->text + from, to - from);
+}
+
+static int prev_char(const struct lineedit *e, int i) {
+  do
+    i--;
+  while(i > 0 && (e->text[i] & 0xC0) == 0x80);
+  return i;
+}
+
+static int next_char(const struct lineedit *e, int i) {
+  return i + utf8_char_bytes(e->text + i);
+}
+
+// the text from `from` to the end of the window, what's after the text stays underlined
+static void draw(struct lineedit *e, int from) {
+  int width = text_width(e);
+  int x = span_width(e, e->scroll, from);
+  wmove(e->win, 0, e->text_x + x);
+  wattron(e->win, A_UNDERLINE);
+  for(int i = from; i < e->len; ) {
+    int bytes = utf8_char_bytes(e->text + i);
+    int char_width = utf8_get_char_width(e->text + i);
+    if(x + char_width > width)
+      break;
+    if(e->is_hidden)
+      for(int j = 0; j < char_width; j++)
+        waddch(e->win, ' ');
+    else
+      waddnstr(e->win, e->text + i, bytes);
+    x += char_width;
+    i += bytes;
+  }
+  for(; x < width; x++)
+    waddch(e->win, ' ');
+  wattroff(e->win, A_UNDERLINE);
+}
+
+static void draw_label(struct lineedit *e) {
+  mvwprintw(e->win, 0, 0, "%-*.*s", e->text_x, e->text_x, e->label);
+}
+
+// the cursor has to be on the screen (with its own cell), returns true if the text moved
+static bool scroll_to_cursor(struct lineedit *e) {
+  int old_scroll = e->scroll;
+  if(e->cursor < e->scroll)
+    e->scroll = e->cursor;
+
+  int width = text_width(e);
+  int cursor_x = span_width(e, e->scroll, e->cursor);
+  while(e->scroll < e->cursor && cursor_x >= width) {
+    cursor_x -= utf8_get_char_width(e->text + e->scroll);
+    e->scroll = next_char(e, e->scroll);
+  }
+  return e->scroll != old_scroll;
+}
+
+static void show_cursor(struct lineedit *e) {
+  wmove(e->win, 0, e->text_x + span_width(e, e->scroll, e->cursor));
+  // moving the cursor doesn't touch the window, and a window that isn't touched isn't refreshed
+  wtouchln(e->win, 0, 1, 1);
+}
+
+// the text changed from `from` on
+static void edited(struct lineedit *e, int from) {
+  if(scroll_to_cursor(e) || from < e->scroll)
+    from = e->scroll;
+  draw(e, from);
+  show_cursor(e);
+}
+
+static void moved(struct lineedit *e) {
+  if(scroll_to_cursor(e))
+    draw(e, e->scroll);
+  show_cursor(e);
+}
+
+void lineedit_init(struct lineedit *e, WINDOW *win, int text_x) {
+  memset(e, 0, sizeof(*e));
+  e->win = win;
+  e->text_x = text_x;
+  draw_label(e);
+  draw(e, 0);
+}
+
+void lineedit_resize(struct lineedit *e) {
+  // a wider window shows again what was scrolled out on the left
+  int width = text_width(e);
+  int text_width = span_width(e, e->scroll, e->len);
+  while(e->scroll > 0) {
+    int prev = prev_char(e, e->scroll);
+    text_width += utf8_get_char_width(e->text + prev);
+    // the cursor at the end has a cell of its own
+    if(text_width >= width)
+      break;
+    e->scroll = prev;
+  }
+  scroll_to_cursor(e);
+  draw_label(e);
+  draw(e, e->scroll);
+  show_cursor(e);
+}
+
+void lineedit_set_label(struct lineedit *e, const char *label) {
+  snprintf(e->label, sizeof(e->label), "%s", label);
+  draw_label(e);
+  show_cursor(e);
+}
+
+void lineedit_set_hidden(struct lineedit *e, bool is_hidden) {
+  if(e->is_hidden == is_hidden)
+    return;
+  e->is_hidden = is_hidden;
+  draw(e, e->scroll);
+  show_cursor(e);
+}
+
+void lineedit_set(struct lineedit *e, const char *text) {
+  int len = strlen(text);
+  if(len > LINEEDIT_MAX) {
+    len = LINEEDIT_MAX;
+    // not in the middle of a character
+    while(len > 0 && (text[len] & 0xC0) == 0x80)
+      len--;
+  }
+  memcpy(e->text, text, len);
+  e->text[len] = '\0';
+  e->len = len;
+  e->cursor = e->scroll = 0;
+  e->pending_len = 0;
+  draw(e, 0);
+  show_cursor(e);
+}
+
+void lineedit_end(struct lineedit *e) {
+  e->cursor = e->len;
+  moved(e);
+}
+
+static void insert(struct lineedit *e, const char *s, int n) {
+  if(e->len + n > LINEEDIT_MAX)
+    return;
+  int at = e->cursor;
+  memmove(e->text + at + n, e->text + at, e->len - at + 1);
+  memcpy(e->text + at, s, n);
+  e->len += n;
+  e->cursor += n;
+  edited(e, at);
+}
+
+static void delete(struct lineedit *e, int from, int to) {
+  memmove(e->text + from, e->text + to, e->len - to + 1);
+  e->len -= to - from;
+  e->cursor = from;
+  edited(e, from);
+}
+
+// a byte of a typed character, the character is inserted when it's whole
+static void type_byte(struct lineedit *e, unsigned char c) {
+  if(e->pending_len > 0) {
+    if((c & 0xC0) == 0x80) {
+      e->pending[e->pending_len++] = c;
+      if(e->pending_len == e->pending_need) {
+        e->pending_len = 0;
+        insert(e, e->pending, e->pending_need);
+      }
+      return;
+    }
+    // it wasn't finished, so it's dropped
+    e->pending_len = 0;
+  }
+
+  if(c < 0x80) {
+    insert(e, (char*)&c, 1);
+    return;
+  }
+  if(c >= 0xC2 && c <= 0xDF)
+    e->pending_need = 2;
+  else if(c >= 0xE0 && c <= 0xEF)
+    e->pending_need = 3;
+  else if(c >= 0xF0 && c <= 0xF4)
+    e->pending_need = 4;
+  else
+    return;
+  e->pending[e->pending_len++] = c;
+}
+
+bool lineedit_key(struct lineedit *e, int ch) {
+  switch(ch) {
+    case KEY_LEFT:
+      if(e->cursor > 0)
+        e->cursor = prev_char(e, e->cursor);
+      moved(e);
+      return true;
+    case KEY_RIGHT:
+      if(e->cursor < e->len)
+        e->cursor = next_char(e, e->cursor);
+      moved(e);
+      return true;
+    case KEY_HOME:
+      e->cursor = 0;
+      moved(e);
+      return true;
+    case KEY_END:
+      lineedit_end(e);
+      return true;
+    case KEY_BACKSPACE:
+    case 127:
+      if(e->cursor > 0)
+        delete(e, prev_char(e, e->cursor), e->cursor);
+      return true;
+    case KEY_DC:
+      if(e->cursor < e->len)
+        delete(e, e->cursor, next_char(e, e->cursor));
+      return true;
+    // https://en.wikipedia.org/wiki/Control_character#How_control_characters_map_to_keyboards
+    // ctrl + w
+    case 'W' - 64:
+      e->len = e->cursor = e->scroll = 0;
+      e->text[0] = '\0';
+      draw(e, 0);
+      show_cursor(e);
+      return true;
+    default:
+      // what isn't a key code or a control character is typed
+      if(ch < 0x20 || ch > 0xFF)
+        return false;
+      type_byte(e, ch);
+      return true;
+  }
+}
+
+const char *lineedit_text(const struct lineedit *e) {
+  return e->text;
+}
+
+char *lineedit_strdup(const struct lineedit *e) {
+  const char *start = e->text, *end = e->text + e->len;
+  while(start < end && isspace((unsigned char)*start))
+    start++;
+  while(end > start && isspace((unsigned char)end[-1]))
+    end--;
+
+  char *s = strndup(start, end - start);
+  if(s == NULL)
+    MALLOC_ERROR;
+  return s;
+}
@@ -0,0 +1,46 @@
+#ifndef GEMINI_LINEEDIT_H
+#define GEMINI_LINEEDIT_H
+
+#include <ncurses.h>
+#include <stdbool.h>
+
+// a one line text input (the url bar and the prompts in it), a label and the text after it,
+// the text is scrolled sideways when it doesn't fit, and only what an edit changed is drawn again
+
+// like the max url length
+#define LINEEDIT_MAX 1024
+
+struct lineedit {
+  WINDOW *win;
+  // the text starts at this column, the label is before it
+  int text_x;
+  char label[16];
+  // utf8, null terminated
+  char text[LINEEDIT_MAX + 1];
+  // all in bytes, scroll is where the shown part starts
+  int len, cursor, scroll;
+  // a typed character comes a byte at a time, it's inserted when it's whole
+  char pending[4];
+  int pending_len, pending_need;
+  // sensitive input, nothing of it is shown
+  bool is_hidden;
+};
+
+void lineedit_init(struct lineedit *e, WINDOW *win, int text_x);
+// after its window was resized
+void lineedit_resize(struct lineedit *e);
+void lineedit_set_label(struct lineedit *e, const char *label);
+void lineedit_set_hidden(struct lineedit *e, bool is_hidden);
+// the cursor goes to the start, so a long url is shown from its start
+void lineedit_set(struct lineedit *e, const char *text);
+void lineedit_end(struct lineedit *e);
+
+// left, right, home, end, backspace, delete, ^W (the whole line) and what's typed,
+// returns false if it's some other key
+bool lineedit_key(struct lineedit *e, int ch);
+
+const char *lineedit_text(const struct lineedit *e);
+// without the whitespace around it
+char *lineedit_strdup(const struct lineedit *e);
+
+#endif
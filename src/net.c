@@ -0,0 +1,134 @@
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "net.h"
+#include "hoststats.h"
+#include "util.h"
+
+int net_connect(const char *hostname, const char *port, const char **error_message) {
+  struct addrinfo hints = {
+    .ai_family = AF_UNSPEC,
+    .ai_socktype = SOCK_STREAM,
+    .ai_protocol = IPPROTO_TCP
+  }, *result;
+
+  int fd = -1;
+  char host[1024];
+  snprintf(host, sizeof(host), "%s:%s", hostname, port);
+  // so, this thing is for the sake of not trying to connect for the infinite amount of time.
+  // it used to be 5 seconds for everyone, now a fast local capsule fails fast, and
+  // a server at the other end of the world still gets its 5 seconds
+  struct timeval connect_tv = hoststats_connect_timeout(host);
+  struct timeval read_tv = hoststats_read_timeout(host);
+
+  if(getaddrinfo(hostname, port, &hints, &result) != 0) {
+    *error_message = "Can't get address info\n";
+    return -1;
+  }
+
+  struct addrinfo *it;
+  int err = 0;
+  for(it = result; it && err != EINTR; it = it->ai_next) {
+    if((fd = socket(it->ai_family, it->ai_socktype | SOCK_CLOEXEC, it->ai_protocol)) == -1) {
+      err = errno;
+      continue;
+    }
+    // connect() is bounded by the send timeout
+    double start = get_monotonic_ms();
+    if(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &connect_tv, sizeof(connect_tv)) == 0 &&
+       connect(fd, it->ai_addr, it->ai_addrlen) == 0) {
+      hoststats_add_connect(host, get_monotonic_ms() - start);
+      if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &read_tv, sizeof(read_tv)) == 0 &&
+         setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &read_tv, sizeof(read_tv)) == 0)
+        break;
+    }
+    err = errno;
+    if(err == EINPROGRESS || err == EAGAIN)
+      hoststats_add_timeout(host);
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(result);
+
+  if(fd == -1)
+    *error_message = (err == EINPROGRESS || err == EAGAIN) ? "Connection timed out\n" : "Can't connect\n";
+
+  return fd;
+}
+
+static int set_read_timeout(int fd, struct timeval tv) {
+  return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+int net_wait_first_byte(int fd, const char *host) {
+  return set_read_timeout(fd, hoststats_first_byte_timeout(host));
+}
+
+int net_got_first_byte(int fd, const char *host, double ms) {
+  hoststats_add_first_byte(host, ms);
+  return set_read_timeout(fd, hoststats_read_timeout(host));
+}
+
+void net_timed_out(const char *host, bool got_first_byte, double ms) {
+  hoststats_add_timeout(host);
+  if(!got_first_byte)
+    hoststats_add_first_byte_timeout(host, ms);
+}
+
+long net_read_all(int fd, const char *host, char **buf, const char **error_message) {
+  net_wait_first_byte(fd, host);
+  double start = get_monotonic_ms();
+  size_t cap = 4096, len = 0;
+  char *res = malloc(cap);
+  if(res == NULL)
+    MALLOC_ERROR;
+
+  for(;;) {
+    if(cap - len < 1536) {
+      cap *= 2;
+      res = realloc(res, cap);
+      if(res == NULL)
+        MALLOC_ERROR;
+    }
+
+    ssize_t n = recv(fd, res + len, cap - len - 1, 0);
+    if(n > 0) {
+      if(len == 0)
+        net_got_first_byte(fd, host, get_monotonic_ms() - start);
+      len += n;
+    }
+    else if(n == 0) {
+      break;
+    }
+    else if(errno != EINTR) {
+      bool is_timeout = errno == EAGAIN || errno == EWOULDBLOCK;
+      // so the next time it waits longer
+      if(is_timeout)
+        net_timed_out(host, len > 0, get_monotonic_ms() - start);
+      *error_message = is_timeout ? "Timed out\n" : "Can't read\n";
+      free(res);
+      return -1;
+    }
+  }
+
+  hoststats_add_transfer(host, len, get_monotonic_ms() - start);
+  res[len] = '\0';
+  *buf = res;
+  return len;
+}
+
+int net_write_all(int fd, const char *buf, size_t size) {
+  size_t written = 0;
+  while(written < size) {
+    ssize_t n = send(fd, buf + written, size - written, MSG_NOSIGNAL);
+    if(n == -1) {
+      if(errno == EINTR)
+        continue;
+      return 0;
+    }
+    written += n;
+  }
+  return 1;
+}
@@ -0,0 +1,24 @@
+#ifndef GEMINI_NET_H
+#define GEMINI_NET_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// plain TCP, shared by the TLS and the plain-text protocol backends
+
+// returns a connected socket or -1 and sets the error_message
+// the deadlines come from the latency history of the host
+int net_connect(const char *hostname, const char *port, const char **error_message);
+// reads until the server closes the connection, the result is null terminated
+// returns the number of bytes read, or -1 and sets the error_message
+// host is "hostname:port" for the latency history
+long net_read_all(int fd, const char *host, char **buf, const char **error_message);
+int net_write_all(int fd, const char *buf, size_t size);
+// waiting for the response, the first byte gets its own deadline (the server may be making the page),
+// then it's the deadline between two reads, both from the history of the host, returns 0 if it can't be set
+int net_wait_first_byte(int fd, const char *host);
+int net_got_first_byte(int fd, const char *host, double ms);
+// a read ran out of time, ms after the response was waited for, so the deadlines of the host get longer
+void net_timed_out(const char *host, bool got_first_byte, double ms);
+
+#endif
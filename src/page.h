@@ -2,19 +2,35 @@
 #define PAGE_H
 #include <stdbool.h>
 #include <stddef.h>
+#include <wchar.h>
+#include "gemtext.h"
+#include "arena.h"
 
+// everything here lives in the arena of the page's layout
 struct screen_line {
   char *text;
+  // the text decoded when it's laid out, so it's drawn without decoding it again,
+  // NULL if it's all printable ascii, then it's drawn from text, len is in characters
+  // (it's not kept as cells, a cchar_t is 28 bytes a column, the cells of a line
+  // are made in one pass when it's drawn)
+  wchar_t *wide;
+  int len;
   char *link;
   unsigned int attr;
 };
 
+struct page_layout;
+
 struct page_t {
   char *url;
-  struct screen_line **lines;
+  // the lines known so far, see layout_ensure_lines
   int lines_num;
   int first_line_index, last_line_index, selected_link_index;
   bool is_bookmarked;
+  // parsed body, the lines are laid out from it
+  struct gemtext_doc doc;
+  // lines for the current width
+  struct page_layout *layout;
 };
 
 
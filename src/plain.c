@@ -0,0 +1,403 @@
+#include <stdarg.h>
+
+#include "plain.h"
+#include "net.h"
+#include "util.h"
+
+// growing buffer for building the responses
+struct strbuf {
+  char *data;
+  size_t len, cap;
+};
+
+static void strbuf_append(struct strbuf *b, const char *s, size_t n) {
+  if(b->len + n + 1 > b->cap) {
+    while(b->len + n + 1 > b->cap)
+      b->cap = b->cap ? b->cap * 2 : 4096;
+    b->data = realloc(b->data, b->cap);
+    if(b->data == NULL)
+      MALLOC_ERROR;
+  }
+  memcpy(b->data + b->len, s, n);
+  b->len += n;
+  b->data[b->len] = '\0';
+}
+
+static void strbuf_printf(struct strbuf *b, const char *format, ...) {
+  char buf[1024];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+
+  if(len < 0)
+    return;
+  if((size_t)len >= sizeof(buf))
+    len = sizeof(buf) - 1;
+  strbuf_append(b, buf, len);
+}
+
+static int hex_value(char c) {
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// decodes in place, returns the new length
+static size_t percent_decode(char *s) {
+  char *out = s, *in = s;
+  while(*in) {
+    int hi, lo;
+    if(*in == '%' && (hi = hex_value(in[1])) != -1 && (lo = hex_value(in[2])) != -1) {
+      *out++ = (char)(hi << 4 | lo);
+      in += 3;
+    }
+    else {
+      *out++ = *in++;
+    }
+  }
+  *out = '\0';
+  return out - s;
+}
+
+// a link url ends on a whitespace, so everything that may break it has to be encoded
+static void strbuf_append_encoded(struct strbuf *b, const char *s, size_t n) {
+  static const char hex[] = "0123456789ABCDEF";
+  for(size_t i = 0; i < n; i++) {
+    unsigned char c = s[i];
+    if(c <= ' ' || c == '%' || c == '?' || c == '#' || c >= 0x7f) {
+      char enc[3] = {'%', hex[c >> 4], hex[c & 0x0f]};
+      strbuf_append(b, enc, 3);
+    }
+    else
+      strbuf_append(b, (char*)&c, 1);
+  }
+}
+
+// host_resource is always set on success, at least to "/"
+static int plain_parse(struct fetch_conn *conn, const char *url, char **hostname, char **host_resource, char port[6], struct response *resp) {
+  *hostname = strdup(url);
+  if(*hostname == NULL)
+    MALLOC_ERROR;
+
+  return parse_url(&resp->error_message, *hostname, host_resource, port, conn->backend->default_port);
+}
+
+static int plain_connect(struct fetch_conn *conn, const char *hostname, const char *port, struct response *resp) {
+  size_t len = strlen(hostname) + 1 + strlen(port) + 1;
+  if((conn->host = malloc(len)) == NULL)
+    MALLOC_ERROR;
+  snprintf(conn->host, len, "%s:%s", hostname, port);
+
+  conn->fd = net_connect(hostname, port, &resp->error_message);
+  return conn->fd != -1;
+}
+
+static int plain_send(struct fetch_conn *conn, const char *request, size_t len, struct response *resp) {
+  if(!net_write_all(conn->fd, request, len)) {
+    resp->error_message = "Can't send the request\n";
+    return 0;
+  }
+  return 1;
+}
+
+// the response of every plain protocol is just whatever comes until the server closes the connection
+static char *plain_read_all(struct fetch_conn *conn, long *len, struct response *resp) {
+  char *raw = NULL;
+  *len = net_read_all(conn->fd, conn->host, &raw, &resp->error_message);
+  if(*len < 0)
+    return NULL;
+  return raw;
+}
+
+static void plain_set_body(struct response *resp, struct strbuf *b) {
+  resp->body = b->data;
+  resp->body_size = b->len;
+  resp->cert_result = TOFU_NO_TLS;
+  resp->was_resumpted = false;
+}
+
+static void plain_close(struct fetch_conn *conn) {
+  if(conn->fd != -1)
+    close(conn->fd);
+  conn->fd = -1;
+}
+
+
+// ########## SPARTAN ##########
+// request:  <host> <path> <content-length>\r\n<data>
+// response: <status> <meta>\r\n<body>, where status is a single digit
+
+static int spartan_connect(struct fetch_conn *conn, const char *url, struct response *resp, char fingerprint[]) {
+  (void)fingerprint;
+  char *hostname = NULL, *host_resource = NULL, port[6] = {0};
+  int ret = 0;
+
+  if(!plain_parse(conn, url, &hostname, &host_resource, port, resp) ||
+     !plain_connect(conn, hostname, port, resp))
+    goto cleanup;
+
+  // the query is sent as the data block
+  char *data = strchr(host_resource, '?');
+  size_t data_len = 0;
+  if(data) {
+    *data++ = '\0';
+    data_len = percent_decode(data);
+  }
+
+  struct strbuf request = {0};
+  strbuf_printf(&request, "%s %s %zu\r\n", hostname, host_resource, data_len);
+  if(data_len)
+    strbuf_append(&request, data, data_len);
+
+  ret = plain_send(conn, request.data, request.len, resp);
+  free(request.data);
+
+cleanup:
+  free(hostname);
+  free(host_resource);
+  return ret;
+}
+
+static int spartan_read(struct fetch_conn *conn, struct response *resp) {
+  long len;
+  char *raw = plain_read_all(conn, &len, resp);
+  if(raw == NULL)
+    return 0;
+
+  char *crlf = strstr(raw, "\r\n");
+  if(len < 3 || raw[0] < '2' || raw[0] > '5' || raw[1] != ' ' || crlf == NULL) {
+    resp->error_message = "Invalid spartan response header!";
+    free(raw);
+    return 0;
+  }
+
+  // 2 success, 3 redirect, 4 client error, 5 server error
+  int status_code;
+  switch(raw[0]) {
+    case '2': status_code = CODE_SUCCESS;            break;
+    case '3': status_code = CODE_REDIRECT_TEMPORARY; break;
+    case '4': status_code = CODE_BAD_REQUEST;        break;
+    default:  status_code = CODE_TEMPORARY_FAILURE;  break;
+  }
+
+  struct strbuf body = {0};
+  strbuf_printf(&body, "%d ", status_code);
+  strbuf_append(&body, raw + 2, len - 2);
+  plain_set_body(resp, &body);
+
+  free(raw);
+  return 1;
+}
+
+const struct fetch_backend spartan_backend = {
+  .protocol = SPARTAN,
+  .default_port = "300",
+  .connect = spartan_connect,
+  .read = spartan_read,
+  .close = plain_close,
+};
+
+
+// ########## FINGER ##########
+// request:  <user>\r\n
+// response: plain text
+
+static int finger_connect(struct fetch_conn *conn, const char *url, struct response *resp, char fingerprint[]) {
+  (void)fingerprint;
+  char *hostname = NULL, *host_resource = NULL, port[6] = {0};
+  int ret = 0;
+
+  if(!plain_parse(conn, url, &hostname, &host_resource, port, resp) ||
+     !plain_connect(conn, hostname, port, resp))
+    goto cleanup;
+
+  // finger://host/user
+  char *user = host_resource + 1;
+  percent_decode(user);
+
+  struct strbuf request = {0};
+  strbuf_printf(&request, "%s\r\n", user);
+  ret = plain_send(conn, request.data, request.len, resp);
+  free(request.data);
+
+cleanup:
+  free(hostname);
+  free(host_resource);
+  return ret;
+}
+
+static int finger_read(struct fetch_conn *conn, struct response *resp) {
+  long len;
+  char *raw = plain_read_all(conn, &len, resp);
+  if(raw == NULL)
+    return 0;
+
+  struct strbuf body = {0};
+  strbuf_printf(&body, "%d text/plain\r\n", CODE_SUCCESS);
+  strbuf_append(&body, raw, len);
+  plain_set_body(resp, &body);
+
+  free(raw);
+  return 1;
+}
+
+const struct fetch_backend finger_backend = {
+  .protocol = FINGER,
+  .default_port = "79",
+  .connect = finger_connect,
+  .read = finger_read,
+  .close = plain_close,
+};
+
+
+// ########## GOPHER ##########
+// url:      gopher://host[:port]/<item type><selector>[?<search>]
+// request:  <selector>[\t<search>]\r\n
+// response: a menu (types 1 and 7), text (0) or a file
+
+static int gopher_connect(struct fetch_conn *conn, const char *url, struct response *resp, char fingerprint[]) {
+  (void)fingerprint;
+  char *hostname = NULL, *host_resource = NULL, port[6] = {0};
+  int ret = 0;
+
+  if(!plain_parse(conn, url, &hostname, &host_resource, port, resp))
+    goto cleanup;
+
+  // "/" is the main menu
+  conn->item_type = host_resource[1] ? host_resource[1] : '1';
+  char *selector = host_resource[1] ? host_resource + 2 : host_resource + 1;
+  char *search = NULL;
+  if(conn->item_type == '7') {
+    // a search without a query, ask the user for it the gemini way
+    if((search = strchr(selector, '?')) == NULL) {
+      ret = 1;
+      goto cleanup;
+    }
+    *search++ = '\0';
+  }
+
+  if(!plain_connect(conn, hostname, port, resp))
+    goto cleanup;
+
+  struct strbuf request = {0};
+  percent_decode(selector);
+  strbuf_append(&request, selector, strlen(selector));
+  if(search) {
+    percent_decode(search);
+    strbuf_append(&request, "\t", 1);
+    strbuf_append(&request, search, strlen(search));
+  }
+  strbuf_append(&request, "\r\n", 2);
+
+  ret = plain_send(conn, request.data, request.len, resp);
+  free(request.data);
+
+cleanup:
+  free(hostname);
+  free(host_resource);
+  return ret;
+}
+
+static void gopher_menu_to_gemtext(struct strbuf *b, char *menu) {
+  char *line = menu, *next;
+  for(; line && *line; line = next) {
+    if((next = strchr(line, '\n')) != NULL)
+      *next++ = '\0';
+    size_t line_len = strlen(line);
+    if(line_len > 0 && line[line_len - 1] == '\r')
+      line[--line_len] = '\0';
+
+    // end of the menu
+    if(strcmp(line, ".") == 0)
+      break;
+    if(line_len == 0)
+      continue;
+
+    char type = line[0];
+    char *fields[4] = {line + 1, "", "", ""};
+    for(int i = 1; i < 4; i++) {
+      char *tab = strchr(fields[i - 1], '\t');
+      if(tab == NULL)
+        break;
+      *tab = '\0';
+      fields[i] = tab + 1;
+    }
+    char *display = fields[0], *selector = fields[1], *host = fields[2], *port = fields[3];
+
+    if(type == 'i' || type == '3' || *host == '\0') {
+      // don't let the informational lines be taken as gemtext lines
+      if(*display == '#' || *display == '>' || *display == '*' || 
+          strncmp(display, "=>", 2) == 0 || strncmp(display, "```", 3) == 0)
+        strbuf_append(b, " ", 1);
+      strbuf_append(b, display, strlen(display));
+    }
+    else if(type == 'h' && strncmp(selector, "URL:", 4) == 0) {
+      strbuf_printf(b, "=> %s %s", selector + 4, display);
+    }
+    else {
+      strbuf_printf(b, "=> gopher://%s", host);
+      if(*port && strcmp(port, "70") != 0)
+        strbuf_printf(b, ":%s", port);
+      strbuf_printf(b, "/%c", type);
+      strbuf_append_encoded(b, selector, strlen(selector));
+      strbuf_printf(b, " %s", display);
+    }
+    strbuf_append(b, "\n", 1);
+  }
+}
+
+static const char *gopher_mime_type(char item_type) {
+  switch(item_type) {
+    case '0': return "text/plain";
+    case '1':
+    case '7': return "text/gemini";
+    case 'h': return "text/html";
+    case 'g': return "image/gif";
+    default:  return "application/octet-stream";
+  }
+}
+
+static int gopher_read(struct fetch_conn *conn, struct response *resp) {
+  struct strbuf body = {0};
+
+  if(conn->fd == -1) {
+    strbuf_printf(&body, "%d Search\r\n", CODE_INPUT);
+    plain_set_body(resp, &body);
+    return 1;
+  }
+
+  long len;
+  char *raw = plain_read_all(conn, &len, resp);
+  if(raw == NULL)
+    return 0;
+
+  strbuf_printf(&body, "%d %s\r\n", CODE_SUCCESS, gopher_mime_type(conn->item_type));
+
+  if(conn->item_type == '1' || conn->item_type == '7') {
+    gopher_menu_to_gemtext(&body, raw);
+  }
+  else {
+    // text files end with a lone "." line
+    if(conn->item_type == '0') {
+      if(len >= 3 && strcmp(raw + len - 3, "\n.\n") == 0)
+        len -= 2;
+      else if(len >= 5 && strcmp(raw + len - 5, "\r\n.\r\n") == 0)
+        len -= 3;
+    }
+    strbuf_append(&body, raw, len);
+  }
+  plain_set_body(resp, &body);
+
+  free(raw);
+  return 1;
+}
+
+const struct fetch_backend gopher_backend = {
+  .protocol = GOPHER,
+  .default_port = "70",
+  .connect = gopher_connect,
+  .read = gopher_read,
+  .close = plain_close,
+};
@@ -0,0 +1,11 @@
+#ifndef GEMINI_PLAIN_H
+#define GEMINI_PLAIN_H
+
+#include "fetch.h"
+
+// plain TCP protocols, no TLS and no TOFU
+extern const struct fetch_backend spartan_backend;
+extern const struct fetch_backend finger_backend;
+extern const struct fetch_backend gopher_backend;
+
+#endif
@@ -0,0 +1,103 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "util.h"
+
+#define POOL_MAX_THREADS 16
+
+static pthread_t threads[POOL_MAX_THREADS];
+static int threads_num = 0;
+static bool quit = false;
+
+// the job, tasks are taken one by one from next_task
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static pool_task_func job_func;
+static void *job_arg;
+static int job_tasks, next_task, done_tasks;
+// only one job at a time
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// with pool_lock held, returns it held too
+static void run_tasks(void) {
+  while(next_task < job_tasks) {
+    int task = next_task++;
+    pthread_mutex_unlock(&pool_lock);
+    job_func(job_arg, task);
+    pthread_mutex_lock(&pool_lock);
+    if(++done_tasks == job_tasks)
+      pthread_cond_signal(&done_cond);
+  }
+}
+
+static void *worker(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&pool_lock);
+  while(!quit) {
+    if(next_task < job_tasks)
+      run_tasks();
+    else
+      pthread_cond_wait(&work_cond, &pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return NULL;
+}
+
+void pool_init(int n) {
+  if(n <= 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  if(n > POOL_MAX_THREADS)
+    n = POOL_MAX_THREADS;
+
+  // the caller is one of them
+  for(int i = 0; i < n - 1; i++) {
+    if(pthread_create(&threads[threads_num], NULL, worker, NULL) != 0) {
+      ERROR_LOG("pool: can't create a thread, running with %d", threads_num + 1);
+      break;
+    }
+    threads_num++;
+  }
+  INFO_LOG("pool: %d threads", threads_num + 1);
+}
+
+void pool_free(void) {
+  pthread_mutex_lock(&pool_lock);
+  quit = true;
+  pthread_cond_broadcast(&work_cond);
+  pthread_mutex_unlock(&pool_lock);
+
+  for(int i = 0; i < threads_num; i++)
+    pthread_join(threads[i], NULL);
+  threads_num = 0;
+  quit = false;
+}
+
+int pool_threads(void) {
+  return threads_num + 1;
+}
+
+void pool_run(pool_task_func func, void *arg, int tasks) {
+  if(threads_num == 0 || tasks == 1) {
+    for(int i = 0; i < tasks; i++)
+      func(arg, i);
+    return;
+  }
+
+  pthread_mutex_lock(&run_lock);
+  pthread_mutex_lock(&pool_lock);
+  job_func = func;
+  job_arg = arg;
+  job_tasks = tasks;
+  next_task = done_tasks = 0;
+  pthread_cond_broadcast(&work_cond);
+
+  run_tasks();
+  while(done_tasks < job_tasks)
+    pthread_cond_wait(&done_cond, &pool_lock);
+
+  job_tasks = next_task = done_tasks = 0;
+  pthread_mutex_unlock(&pool_lock);
+  pthread_mutex_unlock(&run_lock);
+}
@@ -0,0 +1,17 @@
+#ifndef GEMINI_POOL_H
+#define GEMINI_POOL_H
+
+// a few threads for splitting a big job (laying out a huge page) between the cores
+// the caller works on the job too, and pool_run returns when every task of it is done
+
+typedef void (*pool_task_func)(void *arg, int task);
+
+// 0 threads means one per core, without the pool everything runs on the caller
+void pool_init(int threads);
+void pool_free(void);
+// including the caller
+int pool_threads(void);
+// tasks run in any order and at the same time, so they can't share anything writable
+void pool_run(pool_task_func func, void *arg, int tasks);
+
+#endif
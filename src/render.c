@@ -0,0 +1,233 @@
+// for cchar_t
+#define NCURSES_WIDECHAR 1
+#include <term.h>
+
+#include "render.h"
+#include "utf8.h"
+#include "util.h"
+
+#define SYNC_BEGIN "\033[?2026h"
+#define SYNC_END "\033[?2026l"
+
+static bool has_sync;
+// what the main thread writes is counted by the kernel, so the bytes of a frame are 
+// the difference around it, -1 if it's not there
+static int io_fd = -1;
+static struct {
+  long frames, idle_frames;
+  unsigned long long bytes, max_bytes;
+} stats;
+// the cells of the line being drawn, they're only kept for the next one
+static struct {
+  cchar_t *cells;
+  int num, cap;
+} row;
+// the pad of the last frame, a frame that only moves it isn't idle
+static struct render_pad shown_pad;
+
+static bool is_pad_shown(const struct render_pad *pad) {
+  return pad->pad == shown_pad.pad && pad->row == shown_pad.row 
+    && pad->top == shown_pad.top && pad->left == shown_pad.left
+    && pad->bottom == shown_pad.bottom && pad->right == shown_pad.right;
+}
+
+// only the rows that are shown count, the rest of the pad is printed ahead
+static bool is_pad_touched(const struct render_pad *pad) {
+  for(int row = pad->row; row <= pad->row + pad->bottom - pad->top; row++)
+    if(is_linetouched(pad->pad, row) == TRUE)
+      return true;
+  return false;
+}
+
+static bool is_under_pad(WINDOW *win, const struct render_pad *pad) {
+  int y, x, h, w;
+  getbegyx(win, y, x);
+  getmaxyx(win, h, w);
+  return y <= pad->bottom && y + h > pad->top && x <= pad->right && x + w > pad->left;
+}
+
+// "Sync" is an extended terminfo capability (e.g. tmux, kitty, foot)
+static bool terminal_has_sync(void) {
+  char *env = getenv("GEMCURSES_SYNC_OUTPUT");
+  if(env && *env)
+    return strcmp(env, "0") != 0;
+
+  char *sync = tigetstr("Sync");
+  return sync != NULL && sync != (char*)-1;
+}
+
+static unsigned long long written_bytes(void) {
+  char buf[512];
+  if(io_fd == -1)
+    return 0;
+
+  ssize_t n = pread(io_fd, buf, sizeof(buf) - 1, 0);
+  if(n <= 0)
+    return 0;
+  buf[n] = '\0';
+
+  char *wchar = strstr(buf, "wchar:");
+  return wchar ? strtoull(wchar + strlen("wchar:"), NULL, 10) : 0;
+}
+
+static void write_all(const char *s) {
+  size_t len = strlen(s);
+  while(len > 0) {
+    ssize_t n = write(STDOUT_FILENO, s, len);
+    if(n <= 0)
+      return;
+    s += n;
+    len -= n;
+  }
+}
+
+void render_init(void) {
+  has_sync = terminal_has_sync();
+  // per thread, so the log and the other threads aren't counted
+  io_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+  INFO_LOG("render: synchronized output %s", has_sync ? "on" : "off");
+}
+
+void render_free(void) {
+  if(stats.frames > 0) {
+    INFO_LOG(
+        "render: %ld frames (%ld idle), %llu bytes, %llu per frame on average, %llu at most",
+        stats.frames,
+        stats.idle_frames,
+        stats.bytes,
+        stats.bytes / (stats.frames - stats.idle_frames ? stats.frames - stats.idle_frames : 1),
+        stats.max_bytes
+    );
+  }
+  if(io_fd != -1)
+    close(io_fd);
+  io_fd = -1;
+  free(row.cells);
+  row.cells = NULL;
+  row.num = row.cap = 0;
+}
+
+bool render_frame(WINDOW **wins, int wins_num, const struct render_pad *pad) {
+  stats.frames++;
+
+  if(!pad)
+    shown_pad.pad = NULL;
+  bool is_pad_changed = pad && (!is_pad_shown(pad) || is_pad_touched(pad));
+  bool is_touched = is_pad_changed;
+  for(int i = 0; i < wins_num; i++) {
+    if(is_wintouched(wins[i])) {
+      is_touched = true;
+      break;
+    }
+  }
+  if(!is_touched) {
+    stats.idle_frames++;
+    return false;
+  }
+
+  unsigned long long start = written_bytes();
+  for(int i = 0; i < wins_num; i++) {
+    if(is_wintouched(wins[i])) {
+      // it may have been copied over the pad
+      if(pad && is_under_pad(wins[i], pad))
+        is_pad_changed = true;
+    }
+    // one that shows the cursor is refreshed anyway (it copies nothing then), so the cursor goes back to it
+    else if(is_leaveok(wins[i]))
+      continue;
+    if(wnoutrefresh(wins[i]) == ERR)
+      ERROR_LOG_AND_EXIT("Can't refresh window");
+  }
+  // pnoutrefresh compares every shown cell, only the ones that differ are written
+  if(is_pad_changed) {
+    if(pnoutrefresh(pad->pad, pad->row, 0, pad->top, pad->left, pad->bottom, pad->right) == ERR)
+      ERROR_LOG_AND_EXIT("Can't refresh pad");
+    // it only untouches the shown rows
+    untouchwin(pad->pad);
+    shown_pad = *pad;
+  }
+
+  // doupdate flushes its own output before it returns, so nothing gets in between
+  if(has_sync)
+    write_all(SYNC_BEGIN);
+  doupdate();
+  if(has_sync)
+    write_all(SYNC_END);
+
+  unsigned long long bytes = written_bytes() - start;
+  stats.bytes += bytes;
+  if(bytes > stats.max_bytes)
+    stats.max_bytes = bytes;
+  return true;
+}
+
+static cchar_t *add_cell(const cchar_t *blank, wchar_t wc) {
+  if(row.num == row.cap) {
+    row.cap = row.cap ? row.cap * 2 : 256;
+    row.cells = realloc(row.cells, row.cap * sizeof(cchar_t));
+    if(row.cells == NULL)
+      MALLOC_ERROR;
+  }
+  cchar_t *cell = &row.cells[row.num++];
+  *cell = *blank;
+  cell->chars[0] = wc;
+  return cell;
+}
+
+void render_line(WINDOW *win, int y, int x, const struct screen_line *line) {
+  if(line->text == NULL)
+    return;
+
+  // every cell is a copy of this one with another character
+  cchar_t blank;
+  setcchar(&blank, L" ", line->attr & ~A_COLOR, PAIR_NUMBER(line->attr), NULL);
+
+  row.num = 0;
+  // printable ascii, a cell for every byte
+  if(line->wide == NULL) {
+    for(int i = 0; i < line->len; i++)
+      add_cell(&blank, (unsigned char)line->text[i]);
+    mvwadd_wchnstr(win, y, x, row.cells, row.num);
+    return;
+  }
+
+  // the cells are placed the way layout measured them (see utf8_cp_drawn_width)
+  int column = 0;
+  for(int i = 0; i < line->len; i++) {
+    wchar_t wc = line->wide[i];
+    int width = utf8_cp_drawn_width(wc, column);
+    if(wc == '\t') {
+      for(int j = 0; j < width; j++)
+        add_cell(&blank, ' ');
+    }
+    else if(wc < 0x20 || wc == 0x7F) {
+      add_cell(&blank, '^');
+      add_cell(&blank, wc == 0x7F ? '?' : wc + '@');
+    }
+    else if(wc >= 0x80 && wc < 0xA0) {
+      add_cell(&blank, UTF8_REPLACEMENT_CHAR);
+    }
+    else if(utf8_cp_width(wc) == 0) {
+      // a combining character goes into the cell before it
+      cchar_t *cell = row.num > 0 ? &row.cells[row.num - 1] : add_cell(&blank, ' ');
+      for(int j = 1; j < CCHARW_MAX; j++) {
+        if(cell->chars[j] == 0) {
+          cell->chars[j] = wc;
+          break;
+        }
+      }
+    }
+    else {
+      add_cell(&blank, wc);
+    }
+    column += width;
+  }
+  mvwadd_wchnstr(win, y, x, row.cells, row.num);
+}
+
+void render_scroll(WINDOW *win, int n) {
+  // it's off otherwise, so writing the last column of the last row doesn't scroll
+  scrollok(win, true);
+  wscrl(win, n);
+  scrollok(win, false);
+}
@@ -0,0 +1,39 @@
+#ifndef GEMINI_RENDER_H
+#define GEMINI_RENDER_H
+
+#include <ncurses.h>
+#include <stdbool.h>
+
+#include "page.h"
+
+// frames go to the terminal through here, only the windows that changed are copied,
+// a frame where nothing changed writes nothing at all, and if the terminal has 
+// synchronized output (DEC mode 2026), it's shown at once, not row by row
+//
+// with GEMCURSES_SYNC_OUTPUT=1 it's used even if terminfo doesn't know it, 0 turns it off
+
+// after initscr
+void render_init(void);
+// logs what was written
+void render_free(void);
+
+// a part of a pad shown over the windows, it's copied to the screen after them
+struct render_pad {
+  WINDOW *pad;
+  // the pad's row at the top
+  int row;
+  // where on the screen
+  int top, left, bottom, right;
+};
+
+// returns false for an idle frame, pad may be NULL
+bool render_frame(WINDOW **wins, int wins_num, const struct render_pad *pad);
+// copied into the window as it is (mvwadd_wchnstr), without formatting or decoding it,
+// a control character is shown as ^X, like ncurses does, a line takes as many columns
+// as layout measured (see utf8_cp_drawn_width)
+void render_line(WINDOW *win, int y, int x, const struct screen_line *line);
+// by n rows (up if negative), the terminal scrolls them itself (if idlok is on)
+// instead of getting them again, the new rows are blank
+void render_scroll(WINDOW *win, int n);
+
+#endif
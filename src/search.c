@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include "search.h"
+#include "simd.h"
+#include "util.h"
+
+// a backward search goes through blocks of this size from the end
+#define BACKWARD_BLOCK (64 * 1024)
+
+void search_set(struct search *search, const char *pattern) {
+  search_free(search);
+  search->len = strlen(pattern);
+  if(search->len == 0)
+    return;
+
+  search->pattern = strdup(pattern);
+  if(search->pattern == NULL)
+    MALLOC_ERROR;
+
+  search->ignore_case = true;
+  for(size_t i = 0; i < search->len; i++)
+    if(pattern[i] >= 'A' && pattern[i] <= 'Z')
+      search->ignore_case = false;
+}
+
+void search_free(struct search *search) {
+  free(search->pattern);
+  memset(search, 0, sizeof(*search));
+}
+
+static bool equal_ignore_case(const char *a, const char *b, size_t n) {
+  for(size_t i = 0; i < n; i++) {
+    char c = a[i];
+    if(c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    if(c != b[i])
+      return false;
+  }
+  return true;
+}
+
+// only the places where the first and the last byte of the pattern match are compared, 
+// they're found 16 or 32 at once, with the case folded in the vector if it's ignored
+const char *search_find(const struct search *search, const char *s, size_t n) {
+  size_t len = search->len;
+  if(len == 0 || n < len)
+    return NULL;
+
+  const char *end = s + n, *p = s;
+  char first = search->pattern[0], last = search->pattern[len - 1];
+  while((p = simd_find_pair(p, end - p, first, last, len - 1, search->ignore_case)) != NULL) {
+    // the first and the last bytes are the same already
+    if(len <= 2)
+      return p;
+    if(search->ignore_case ? equal_ignore_case(p + 1, search->pattern + 1, len - 2)
+                           : memcmp(p + 1, search->pattern + 1, len - 2) == 0)
+      return p;
+    p++;
+  }
+  return NULL;
+}
+
+const char *search_find_last(const struct search *search, const char *s, size_t n) {
+  const char *end = s + n;
+
+  // the blocks overlap by len - 1 bytes, so every one of them goes BACKWARD_BLOCK back, however long the pattern is
+  size_t block = BACKWARD_BLOCK + search->len - 1;
+  while(end - s >= (long)search->len) {
+    const char *start = (size_t)(end - s) > block ? end - block : s;
+    const char *match = NULL, *p = start;
+    while((p = search_find(search, p, end - p)) != NULL) {
+      match = p;
+      p++;
+    }
+    if(match || start == s)
+      return match;
+    // a match can go over the start of the block
+    end = start + search->len - 1;
+  }
+  return NULL;
+}
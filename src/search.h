@@ -0,0 +1,28 @@
+#ifndef GEMINI_SEARCH_H
+#define GEMINI_SEARCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// finding a text in a page, it's searched in the raw body and the matches are byte offsets
+// the case is ignored (ascii only) if the pattern has no upper case letters
+
+struct search {
+  char *pattern;
+  size_t len;
+  bool ignore_case;
+};
+
+// an empty pattern finds nothing, the pattern is copied
+void search_set(struct search *search, const char *pattern);
+void search_free(struct search *search);
+static inline bool search_is_active(const struct search *search) {
+  return search->len > 0;
+}
+
+// the first match in s, NULL if there's none
+const char *search_find(const struct search *search, const char *s, size_t n);
+// the last match in s
+const char *search_find_last(const struct search *search, const char *s, size_t n);
+
+#endif
@@ -0,0 +1,306 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+struct simd_kernels {
+  size_t (*count_byte)(const char *s, size_t n, char c);
+  const char *(*find_byte)(const char *s, size_t n, char c);
+  long (*last_byte)(const char *s, size_t n, char c);
+  size_t (*ascii_printable_len)(const char *s, size_t n);
+  const char *(*find_pair)(const char *s, size_t n, char first, char last, size_t gap, bool fold);
+};
+
+// ########## SCALAR ##########
+
+static size_t count_byte_scalar(const char *s, size_t n, char c) {
+  size_t count = 0;
+  for(size_t i = 0; i < n; i++)
+    count += s[i] == c;
+  return count;
+}
+
+static const char *find_byte_scalar(const char *s, size_t n, char c) {
+  for(size_t i = 0; i < n; i++)
+    if(s[i] == c)
+      return s + i;
+  return NULL;
+}
+
+static long last_byte_scalar(const char *s, size_t n, char c) {
+  for(size_t i = n; i > 0; i--)
+    if(s[i - 1] == c)
+      return i - 1;
+  return -1;
+}
+
+static size_t ascii_printable_len_scalar(const char *s, size_t n) {
+  size_t i = 0;
+  while(i < n && (unsigned char)s[i] >= 0x20 && (unsigned char)s[i] < 0x7F)
+    i++;
+  return i;
+}
+
+static inline char fold_scalar(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static const char *find_pair_scalar(const char *s, size_t n, char first, char last, size_t gap, bool fold) {
+  for(size_t i = 0; i + gap < n; i++) {
+    char a = fold ? fold_scalar(s[i]) : s[i];
+    char b = fold ? fold_scalar(s[i + gap]) : s[i + gap];
+    if(a == first && b == last)
+      return s + i;
+  }
+  return NULL;
+}
+
+static const struct simd_kernels scalar_kernels = {
+  count_byte_scalar, find_byte_scalar, last_byte_scalar, ascii_printable_len_scalar,
+  find_pair_scalar,
+};
+
+#ifdef SIMD_X86
+// ########## SSE2 ##########
+// the tails shorter than a vector go through the scalar versions
+
+__attribute__((target("sse2")))
+static size_t count_byte_sse2(const char *s, size_t n, char c) {
+  __m128i needle = _mm_set1_epi8(c);
+  size_t count = 0, i = 0;
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+  }
+  return count + count_byte_scalar(s + i, n - i, c);
+}
+
+__attribute__((target("sse2")))
+static const char *find_byte_sse2(const char *s, size_t n, char c) {
+  __m128i needle = _mm_set1_epi8(c);
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if(mask)
+      return s + i + __builtin_ctz(mask);
+  }
+  return find_byte_scalar(s + i, n - i, c);
+}
+
+__attribute__((target("sse2")))
+static long last_byte_sse2(const char *s, size_t n, char c) {
+  __m128i needle = _mm_set1_epi8(c);
+  size_t i = n;
+  for(; i >= 16; i -= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(s + i - 16));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if(mask)
+      return i - 16 + 31 - __builtin_clz(mask);
+  }
+  return last_byte_scalar(s, i, c);
+}
+
+__attribute__((target("sse2")))
+static size_t ascii_printable_len_sse2(const char *s, size_t n) {
+  // as signed bytes, everything >= 0x80 is negative, so one compare for each end
+  __m128i low = _mm_set1_epi8(0x1F), high = _mm_set1_epi8(0x7F);
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmplt_epi8(v, high));
+    int mask = _mm_movemask_epi8(ok);
+    if(mask != 0xFFFF)
+      return i + __builtin_ctz(~mask);
+  }
+  return i + ascii_printable_len_scalar(s + i, n - i);
+}
+
+// 'A'-'Z' get 0x20 added, as signed bytes everything >= 0x80 is below 'A'
+__attribute__((target("sse2")))
+static inline __m128i fold_sse2(__m128i v) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("sse2")))
+static const char *find_pair_sse2(const char *s, size_t n, char first, char last, size_t gap, bool fold) {
+  __m128i first_v = _mm_set1_epi8(first), last_v = _mm_set1_epi8(last);
+  size_t i = 0;
+  for(; i + gap + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(s + i + gap));
+    if(fold) {
+      a = fold_sse2(a);
+      b = fold_sse2(b);
+    }
+    int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first_v), _mm_cmpeq_epi8(b, last_v)));
+    if(mask)
+      return s + i + __builtin_ctz(mask);
+  }
+  return find_pair_scalar(s + i, n - i, first, last, gap, fold);
+}
+
+static const struct simd_kernels sse2_kernels = {
+  count_byte_sse2, find_byte_sse2, last_byte_sse2, ascii_printable_len_sse2,
+  find_pair_sse2,
+};
+
+// ########## AVX2 ##########
+// the tails don't go through sse2, mixing legacy sse with avx code stalls on some cpus
+
+__attribute__((target("avx2")))
+static size_t count_byte_avx2(const char *s, size_t n, char c) {
+  __m256i needle = _mm256_set1_epi8(c);
+  size_t count = 0, i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+    count += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+  }
+  return count + count_byte_scalar(s + i, n - i, c);
+}
+
+__attribute__((target("avx2")))
+static const char *find_byte_avx2(const char *s, size_t n, char c) {
+  __m256i needle = _mm256_set1_epi8(c);
+  size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+    if(mask)
+      return s + i + __builtin_ctz(mask);
+  }
+  return find_byte_scalar(s + i, n - i, c);
+}
+
+__attribute__((target("avx2")))
+static long last_byte_avx2(const char *s, size_t n, char c) {
+  __m256i needle = _mm256_set1_epi8(c);
+  size_t i = n;
+  for(; i >= 32; i -= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(s + i - 32));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+    if(mask)
+      return i - 32 + 31 - __builtin_clz(mask);
+  }
+  return last_byte_scalar(s, i, c);
+}
+
+__attribute__((target("avx2")))
+static size_t ascii_printable_len_avx2(const char *s, size_t n) {
+  __m256i low = _mm256_set1_epi8(0x1F), high = _mm256_set1_epi8(0x7F);
+  size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+    __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v));
+    unsigned mask = _mm256_movemask_epi8(ok);
+    if(mask != 0xFFFFFFFF)
+      return i + __builtin_ctz(~mask);
+  }
+  return i + ascii_printable_len_scalar(s + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_avx2(__m256i v) {
+  __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+  return _mm256_add_epi8(v, _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("avx2")))
+static const char *find_pair_avx2(const char *s, size_t n, char first, char last, size_t gap, bool fold) {
+  __m256i first_v = _mm256_set1_epi8(first), last_v = _mm256_set1_epi8(last);
+  size_t i = 0;
+  for(; i + gap + 32 <= n; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(s + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(s + i + gap));
+    if(fold) {
+      a = fold_avx2(a);
+      b = fold_avx2(b);
+    }
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first_v), _mm256_cmpeq_epi8(b, last_v)));
+    if(mask)
+      return s + i + __builtin_ctz(mask);
+  }
+  return find_pair_scalar(s + i, n - i, first, last, gap, fold);
+}
+
+static const struct simd_kernels avx2_kernels = {
+  count_byte_avx2, find_byte_avx2, last_byte_avx2, ascii_printable_len_avx2,
+  find_pair_avx2,
+};
+#endif
+
+// ########## DISPATCH ##########
+
+static const struct simd_kernels *kernels = &scalar_kernels;
+static enum simd_level level = SIMD_SCALAR;
+
+static enum simd_level cpu_level(void) {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+  if(__builtin_cpu_supports("sse2"))
+    return SIMD_SSE2;
+#endif
+  return SIMD_SCALAR;
+}
+
+void simd_set_level(enum simd_level new_level) {
+  enum simd_level max_level = cpu_level();
+  if(new_level > max_level)
+    new_level = max_level;
+
+  level = new_level;
+  switch(level) {
+#ifdef SIMD_X86
+    case SIMD_AVX2: kernels = &avx2_kernels; break;
+    case SIMD_SSE2: kernels = &sse2_kernels; break;
+#endif
+    default:        kernels = &scalar_kernels; break;
+  }
+}
+
+// before main, so there's no race between threads picking it
+__attribute__((constructor))
+static void simd_init(void) {
+  simd_set_level(SIMD_AVX2);
+}
+
+enum simd_level simd_get_level(void) {
+  return level;
+}
+
+const char *simd_level_name(void) {
+  static const char *names[] = {
+    [SIMD_SCALAR] = "scalar",
+    [SIMD_SSE2] = "sse2",
+    [SIMD_AVX2] = "avx2",
+  };
+  return names[level];
+}
+
+size_t simd_count_byte(const char *s, size_t n, char c) {
+  return kernels->count_byte(s, n, c);
+}
+
+const char *simd_find_byte(const char *s, size_t n, char c) {
+  return kernels->find_byte(s, n, c);
+}
+
+long simd_last_byte(const char *s, size_t n, char c) {
+  return kernels->last_byte(s, n, c);
+}
+
+size_t simd_ascii_printable_len(const char *s, size_t n) {
+  return kernels->ascii_printable_len(s, n);
+}
+
+const char *simd_find_pair(const char *s, size_t n, char first, char last, size_t gap, bool fold) {
+  return kernels->find_pair(s, n, first, last, gap, fold);
+}
@@ -0,0 +1,30 @@
+#ifndef GEMINI_SIMD_H
+#define GEMINI_SIMD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// byte scanning kernels for the parsing and layout hot paths
+// the best one the cpu has (avx2, sse2 or plain c) is picked at startup
+
+enum simd_level {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2};
+
+// for benchmarks, it's clamped to what the cpu supports
+void simd_set_level(enum simd_level level);
+enum simd_level simd_get_level(void);
+const char *simd_level_name(void);
+
+size_t simd_count_byte(const char *s, size_t n, char c);
+// NULL if there's none
+const char *simd_find_byte(const char *s, size_t n, char c);
+// index of the last c, -1 if there's none
+long simd_last_byte(const char *s, size_t n, char c);
+// length of the run of printable ascii (' ' to '~') at the start,
+// every one of them is one column wide, so the run needs no decoding
+size_t simd_ascii_printable_len(const char *s, size_t n);
+// the first place where s[i] is first and s[i + gap] is last (with fold, 'A'-'Z' are lowercased,
+// first and last have to be lower case already), NULL if there's none, 
+// a substring search checks only these candidates
+const char *simd_find_pair(const char *s, size_t n, char first, char last, size_t gap, bool fold);
+
+#endif
@@ -1,23 +1,34 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <stdbool.h>
+#include <errno.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <assert.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "tls.h"
+#include "net.h"
+#include "hoststats.h"
 #include "util.h"
 
 #define GEMINI_SCHEME "gemini://"
+#define TITAN_SCHEME "titan://"
 #define DEFAULT_HOST_PORT "1965"
 #define CLRN "\r\n"
 
 #define KEY_FILENAME "key.pem" 
 #define CERT_FILENAME  "cert.pem"
 
+// an upload is mapped this much at a time, so the resident memory doesn't grow with the file
+#define UPLOAD_WINDOW (4 * 1024 * 1024)
+// one tls record
+#define UPLOAD_CHUNK (16 * 1024)
+
 static int all_status_codes[] = {10, 11, 20, 30, 31, 40, 41, 42, 43, 44, 50, 51, 52, 53, 59, 60, 61, 62};
 
 struct session_reuse {
@@ -28,22 +39,24 @@ struct session_reuse {
  
 struct gemini_tls {
   SSL_CTX *ctx;
-  SSL *ssl;
-  BIO *bio_web, *bio_out, *bio_mem;
+  // guards host and session, the callbacks may be called from any thread
+  pthread_mutex_t lock;
   struct known_host *host;
   struct session_reuse *session;
   int session_indx;
-  int res;
-  char *cur_hostname;
 };
 
+struct gemini_conn {
+  struct gemini_tls *gem_tls;
+  SSL *ssl;
+  BIO *bio_web, *bio_mem;
+  int fd;
+  char *cur_hostname;
+};
 
-struct known_host *gem_tls_get_known_hosts(struct gemini_tls *gem_tls) {
-  return gem_tls->host;
-}
 
-char *gem_tls_get_cur_hostname(struct gemini_tls *gem_tls) {
-  return gem_tls->cur_hostname;
+char *gem_tls_get_cur_hostname(struct gemini_conn *conn) {
+  return conn->cur_hostname;
 }
 
 static void init_openssl_library(void) {
@@ -54,15 +67,19 @@ static void init_openssl_library(void) {
 static int ssl_session_new_callback(SSL *ssl, SSL_SESSION *session) {
   if(!session) return 0;
 
-  struct gemini_tls *gem_tls;
-  if((gem_tls = (struct gemini_tls*)SSL_get_ex_data(ssl, 0)) == NULL)
+  struct gemini_conn *conn;
+  if((conn = (struct gemini_conn*)SSL_get_ex_data(ssl, 0)) == NULL)
     ERROR_LOG_AND_EXIT("Can't get ex data");
   
+  struct gemini_tls *gem_tls = conn->gem_tls;
+  pthread_mutex_lock(&gem_tls->lock);
+
   struct session_reuse *sess_p = gem_tls->session;
   while(sess_p) {
-//    INFO_LOG("sess_p->hostname: %s, gem_tls->cur_hostname: %s, are_equal: %d\n", sess_p->hostname, gem_tls->cur_hostname, strcmp(gem_tls->cur_hostname, sess_p->hostname));
-    if(strcmp(gem_tls->cur_hostname, sess_p->hostname) == 0){
+//    INFO_LOG("sess_p->hostname: %s, conn->cur_hostname: %s, are_equal: %d\n", sess_p->hostname, conn->cur_hostname, strcmp(conn->cur_hostname, sess_p->hostname));
+    if(strcmp(conn->cur_hostname, sess_p->hostname) == 0){
       sess_p->session = session;
+      pthread_mutex_unlock(&gem_tls->lock);
       return 0;
     }
     sess_p = sess_p->next;
@@ -71,21 +88,28 @@ static int ssl_session_new_callback(SSL *ssl, SSL_SESSION *session) {
  
   struct session_reuse *tmp_sess;
   tmp_sess = (struct session_reuse*) calloc(1, sizeof(struct session_reuse));
-  //INFO_LOG("cur_hostname: %s", gem_tls->cur_hostname);
-  tmp_sess->hostname = strdup(gem_tls->cur_hostname);  
+  if(tmp_sess == NULL)
+    MALLOC_ERROR;
+  //INFO_LOG("cur_hostname: %s", conn->cur_hostname);
+  tmp_sess->hostname = strdup(conn->cur_hostname);  
   tmp_sess->session = session;
   tmp_sess->next = gem_tls->session;
   gem_tls->session = tmp_sess;
 
   gem_tls->session_indx++;
+  pthread_mutex_unlock(&gem_tls->lock);
   return 0;
 }
 
+// gem_tls->lock has to be held
 static void tls_remove_session(struct gemini_tls *gem_tls, SSL_SESSION *session) {
 
   struct session_reuse *sess_p = gem_tls->session;
   struct session_reuse *sess_found = NULL;
 
+  if(sess_p == NULL)
+    return;
+
   if(sess_p->session == session) {
     sess_found = sess_p;
     if(sess_p->next)
@@ -114,7 +138,9 @@ static void ssl_session_remove_callback(SSL_CTX *ctx, SSL_SESSION *session) {
   if((gem_tls = (struct gemini_tls*)SSL_CTX_get_ex_data(ctx, 0)) == NULL)
     ERROR_LOG_AND_EXIT("Can't get ex data");
 
+  pthread_mutex_lock(&gem_tls->lock);
   tls_remove_session(gem_tls, session);
+  pthread_mutex_unlock(&gem_tls->lock);
 }
 
 // for debugging
@@ -147,33 +173,40 @@ static void ssl_info_callback(const SSL * ssl, int where, int ret){
 }
 
 
-SSL_SESSION *tls_get_session(struct gemini_tls *gem_tls, const char *hostname) {
-  struct session_reuse *sess_p = gem_tls->session;
+// returns a new reference, so the session can't be freed by another thread before it's used
+static SSL_SESSION *tls_get_session(struct gemini_tls *gem_tls, const char *hostname) {
+  SSL_SESSION *session = NULL;
 
+  pthread_mutex_lock(&gem_tls->lock);
+  struct session_reuse *sess_p = gem_tls->session;
   while(sess_p) {
     if(strcmp(hostname, sess_p->hostname) == 0){    
-      return sess_p->session;
+      session = sess_p->session;
+      if(session)
+        SSL_SESSION_up_ref(session);
+      break;
     }
     sess_p = sess_p->next;
   }
+  pthread_mutex_unlock(&gem_tls->lock);
 
-  return NULL;
+  return session;
 }
 
 
-int parse_url(const char **error_message, char *hostname, char **host_resource, char port[6]) {
-  size_t gemini_scheme_length = strlen(GEMINI_SCHEME);
-  // at first delete gemini scheme from hostname if it is included
-  if(strncmp(hostname, GEMINI_SCHEME, gemini_scheme_length) == 0) {
+int parse_url(const char **error_message, char *hostname, char **host_resource, char port[6], const char *default_port) {
+  // at first delete the scheme (gemini://, spartan://...) from hostname if it is included
+  char *no_scheme = skip_url_scheme(hostname);
+  if(no_scheme != hostname) {
     // + 1 for '\0'
-    memmove(hostname, hostname + gemini_scheme_length, strlen(hostname) - gemini_scheme_length + 1);
+    memmove(hostname, no_scheme, strlen(no_scheme) + 1);
   }
   
   // then check if there's port number included
   char *p_port = strchr(hostname, ':');
   char *p_slash = strchr(hostname, '/');
   // ':' may be included in url, so check if it's after domain name and before any dir
-  if(p_port != NULL && p_port < p_slash) {
+  if(p_port != NULL && (p_slash == NULL || p_port < p_slash)) {
     p_port++;
     int i = 0;
 
@@ -193,7 +226,7 @@ int parse_url(const char **error_message, char *hostname, char **host_resource,
     memmove(p_port - i - 1, p_port, strlen(p_port) + 1);
   }
   else {
-    strcpy(port, DEFAULT_HOST_PORT);
+    strcpy(port, default_port ? default_port : DEFAULT_HOST_PORT);
   }
 
   // get the resource if included and cut it from the hostname
@@ -360,6 +393,8 @@ struct gemini_tls* init_tls(uint32_t option_flags) {
   gem_tls->session_indx = 0;
   gem_tls->session = NULL;
   gem_tls->host = NULL;
+  if(pthread_mutex_init(&gem_tls->lock, NULL) != 0)
+    ERROR_LOG_AND_ABORT("Can't init mutex");
   if(!tofu_load_certs(&gem_tls->host))
     gem_tls->host = NULL;
 
@@ -400,34 +435,75 @@ struct gemini_tls* init_tls(uint32_t option_flags) {
   const uint64_t tls_flags = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION;
   SSL_CTX_set_options(gem_tls->ctx, tls_flags);
 
-  gem_tls->bio_web = BIO_new_ssl_connect(gem_tls->ctx);
-  if(gem_tls->bio_web == NULL)
-    ERROR_LOG_AND_ABORT("Can't create bio new ssl connect");
-  
-  gem_tls->bio_out = BIO_new_fp(stdout, BIO_NOCLOSE);
-  if(gem_tls->bio_out == NULL)
-    ERROR_LOG_AND_ABORT("Can't create new fp");
- 
-  gem_tls->bio_mem = BIO_new(BIO_s_mem());
-  if(gem_tls->bio_mem == NULL)
-    ERROR_LOG_AND_ABORT("Can't create new fp");
-
-  BIO_get_ssl(gem_tls->bio_web, &gem_tls->ssl);
-  if(gem_tls->ssl == NULL)
-    ERROR_LOG_AND_ABORT("Can't get ssl");
-  
+  // set once on the context, every new SSL inherits it
   const char* const PREFERRED_CIPHERS = "HIGH:!aNULL:!kRSA:!PSK:!SRP:!MD5:!RC4";
-  int res = SSL_set_cipher_list(gem_tls->ssl, PREFERRED_CIPHERS);
+  int res = SSL_CTX_set_cipher_list(gem_tls->ctx, PREFERRED_CIPHERS);
   if(res == 0)
     ERROR_LOG_AND_ABORT("Can't set cipher list");
 
-  // use ex data in callbacks 
-  SSL_set_ex_data(gem_tls->ssl, 0, gem_tls);
+  // use ex data in the remove callback
   SSL_CTX_set_ex_data(gem_tls->ctx, 0, gem_tls);
 
   return gem_tls;
 }
 
+struct gemini_conn *tls_conn_new(struct gemini_tls *gem_tls) {
+  struct gemini_conn *conn = (struct gemini_conn*) calloc(1, sizeof(struct gemini_conn));
+  if(!conn)
+    MALLOC_ERROR;
+
+  conn->gem_tls = gem_tls;
+  conn->fd = -1;
+
+  // SSL_new is thread safe on a shared context
+  conn->bio_web = BIO_new_ssl_connect(gem_tls->ctx);
+  if(conn->bio_web == NULL)
+    ERROR_LOG_AND_ABORT("Can't create bio new ssl connect");
+ 
+  conn->bio_mem = BIO_new(BIO_s_mem());
+  if(conn->bio_mem == NULL)
+    ERROR_LOG_AND_ABORT("Can't create new mem bio");
+
+  BIO_get_ssl(conn->bio_web, &conn->ssl);
+  if(conn->ssl == NULL)
+    ERROR_LOG_AND_ABORT("Can't get ssl");
+
+  // use ex data in the new session callback
+  SSL_set_ex_data(conn->ssl, 0, conn);
+
+  return conn;
+}
+
+void tls_conn_free(struct gemini_conn *conn) {
+  // (the previous code stopped working since openssl 3.2.0)
+  // it turns out that i shouldn't have been doing just BIO_reset, because it's not 
+  // completely clearing the state
+  // i've read that freeing the bio_web object and initalizing it again is safer.
+  // so every request just gets its own bio_web, valgrind seems happy :) 
+  if(conn == NULL)
+    return;
+
+  if(conn->bio_web != NULL) {
+    BIO_ssl_shutdown(conn->bio_web);
+    BIO_free_all(conn->bio_web);
+  }
+  if(conn->bio_mem != NULL)
+    BIO_free(conn->bio_mem);
+  if(conn->fd != -1)
+    close(conn->fd);
+  if(conn->cur_hostname != NULL)
+    free(conn->cur_hostname);
+
+  free(conn);
+}
+
+void tls_trust_cert(struct gemini_conn *conn, char fingerprint[]) {
+  struct gemini_tls *gem_tls = conn->gem_tls;
+  pthread_mutex_lock(&gem_tls->lock);
+  tofu_change_cert(gem_tls->host, conn->cur_hostname, fingerprint);
+  pthread_mutex_unlock(&gem_tls->lock);
+}
+
 const char *tls_get_error(SSL *ssl, int res) {
 // https://www.openssl.org/docs/man1.1.1/man3/SSL_get_error.html
   switch(SSL_get_error(ssl, res)) {
@@ -448,7 +524,7 @@ const char *tls_get_error(SSL *ssl, int res) {
 }
 
 
-int tls_connect(struct gemini_tls *gem_tls, const char *h, struct response *resp, char *fingerprint) {
+int tls_connect(struct gemini_conn *conn, const char *h, struct response *resp, char *fingerprint) {
   long res = 1;
   int return_val = 1;
   char *hostname = strdup(h);
@@ -459,7 +535,7 @@ int tls_connect(struct gemini_tls *gem_tls, const char *h, struct response *resp
   if(hostname == NULL)
     MALLOC_ERROR;
   
-  if(!parse_url(&resp->error_message, hostname, &host_resource, host_port))
+  if(!parse_url(&resp->error_message, hostname, &host_resource, host_port, DEFAULT_HOST_PORT))
     goto error;
 
   snprintf(
@@ -468,50 +544,18 @@ int tls_connect(struct gemini_tls *gem_tls, const char *h, struct response *resp
     "%s:%s", hostname, host_port
   );
 
-  gem_tls->cur_hostname = strdup(hostname_with_portn);
-
-  struct addrinfo hints = {
-    .ai_family = AF_UNSPEC,
-    .ai_socktype = SOCK_STREAM,
-    .ai_protocol = IPPROTO_TCP
-  }, *result;
-
-  int fd = -1;
-  struct timeval tv = {0};
-  // so, this thing is for the sake of not trying to connect for the infinite amount of time.
-  // 5 seconds is quite long, but it can take long if you're trying to connect to some server at the other end of the world
-  tv.tv_sec = 5;
+  struct gemini_tls *gem_tls = conn->gem_tls;
+  conn->cur_hostname = strdup(hostname_with_portn);
 
-  if((res = getaddrinfo(hostname, host_port, &hints, &result)) != 0) {
-    resp->error_message = "Can't get address info\n";
+  int fd = net_connect(hostname, host_port, &resp->error_message);
+  if(fd == -1)
     goto error;
-  }
-
-  struct addrinfo *it;
-  int err = 0;
-  for(it = result; it && err != EINTR; it = it->ai_next) {
-    if((fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol)) == -1) {
-      err = errno;
-      continue;
-    }
-    if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0 &&
-       setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == 0 &&
-       connect(fd, it->ai_addr, it->ai_addrlen) == 0) {
-      break;
-    }
-    err = errno;
-    close(fd);
-    fd = -1;
-  }
-
-  freeaddrinfo(result);
 
-  if(fd == -1) {
-    resp->error_message = "Can't connect\n";
-    goto error;
-  }
+  // SSL_set_fd doesn't close the socket, so remember it for tls_conn_free
+  conn->fd = fd;
+  SSL_set_fd(conn->ssl, fd);
 
-  res = SSL_set_tlsext_host_name(gem_tls->ssl, hostname);
+  res = SSL_set_tlsext_host_name(conn->ssl, hostname);
   if(res == 0) {
     resp->error_message = "Can't set hostname\n";
     goto error;
@@ -520,27 +564,40 @@ int tls_connect(struct gemini_tls *gem_tls, const char *h, struct response *resp
   SSL_SESSION *session = NULL;
   if((session = tls_get_session(gem_tls, hostname_with_portn)) != NULL) {
     if(SSL_SESSION_is_resumable(session))
-      SSL_set_session(gem_tls->ssl, session);
+      SSL_set_session(conn->ssl, session);
   }
 
-  SSL_set_fd(gem_tls->ssl, fd);
-  
-  res = BIO_do_handshake(gem_tls->bio_web);
+  double handshake_start = get_monotonic_ms();
+  errno = 0;
+  res = BIO_do_handshake(conn->bio_web);
   if(res <= 0) {
-    resp->error_message = tls_get_error(gem_tls->ssl, res);;
+    resp->error_message = tls_get_error(conn->ssl, res);
+    // the socket's read timeout ran out, the next one waits longer
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      hoststats_add_timeout(conn->cur_hostname);
+      resp->error_message = "Handshake timed out\n";
+    }
+    if(session)
+      SSL_SESSION_free(session);
     goto error;
   }
 
-  if(SSL_session_reused(gem_tls->ssl) == 1)
+  hoststats_add_handshake(conn->cur_hostname, get_monotonic_ms() - handshake_start);
+
+  if(SSL_session_reused(conn->ssl) == 1)
     resp->was_resumpted = true;
   else {
     resp->was_resumpted = false;
     if(session) {
+      pthread_mutex_lock(&gem_tls->lock);
       tls_remove_session(gem_tls, session);
+      pthread_mutex_unlock(&gem_tls->lock);
     }
   }
+  if(session)
+    SSL_SESSION_free(session);
 
-  cert = SSL_get_peer_certificate(gem_tls->ssl);
+  cert = SSL_get_peer_certificate(conn->ssl);
   if(cert == NULL) {
     resp->error_message = "Can't get peer cert\n";
     goto error;
@@ -552,21 +609,27 @@ int tls_connect(struct gemini_tls *gem_tls, const char *h, struct response *resp
   }
 
   // there may be different certs on different ports and subdomains
+  pthread_mutex_lock(&gem_tls->lock);
   resp->cert_result = tofu_check_cert(&gem_tls->host, hostname_with_portn, hash); 
+  pthread_mutex_unlock(&gem_tls->lock);
    
   strcpy(fingerprint, hash);
   // printf("CERT: %s", hash);
 
+  // titan uploads are sent to the same host with the same cert, only the scheme differs
+  const char *scheme = GEMINI_SCHEME;
+  if(strncmp(h, TITAN_SCHEME, strlen(TITAN_SCHEME)) == 0)
+    scheme = TITAN_SCHEME;
+
   char url[1024];
-  int url_len = snprintf(url, sizeof(url), (GEMINI_SCHEME "%s%s" CLRN), hostname, host_resource);
+  int url_len = snprintf(url, sizeof(url), ("%s%s%s" CLRN), scheme, hostname, host_resource);
   assert(url_len > 0);
   if((size_t)url_len > sizeof(url)) {
     resp->error_message = "Too long url (max 1024 bytes)\n";
     goto error;
   }
 
-  BIO_puts(gem_tls->bio_web, url);
-  BIO_puts(gem_tls->bio_out, "\n");
+  BIO_puts(conn->bio_web, url);
   
   assert(return_val == 1);
   goto cleanup;
@@ -588,29 +651,54 @@ cleanup:
 }
 
 
-int tls_read(struct gemini_tls *gem_tls, struct response *resp) {
+void response_free(struct response *resp) {
+  if(resp == NULL)
+    return;
+  if(resp->mapped_size)
+    munmap(resp->body, resp->mapped_size);
+  else
+    free(resp->body);
+  free(resp->meta);
+  free(resp);
+}
+
+int tls_read(struct gemini_conn *conn, struct response *resp) {
   int len = 0;
   char buff[1536];
   int written = 0;
+  double start = get_monotonic_ms();
+  if(conn->cur_hostname)
+    net_wait_first_byte(conn->fd, conn->cur_hostname);
 
   do {
-    len = BIO_read(gem_tls->bio_web, buff, sizeof(buff));
-    BIO_flush(gem_tls->bio_web);
+    errno = 0;
+    len = BIO_read(conn->bio_web, buff, sizeof(buff));
+    BIO_flush(conn->bio_web);
     if(len > 0){
-      BIO_write(gem_tls->bio_mem, buff, len);
+      if(written == 0 && conn->cur_hostname)
+        net_got_first_byte(conn->fd, conn->cur_hostname, get_monotonic_ms() - start);
+      BIO_write(conn->bio_mem, buff, len);
       written += len;
     }
     else if(len == 0) {
       break;
     }
     else {
-      resp->error_message = tls_get_error(gem_tls->ssl, len);
+      resp->error_message = tls_get_error(conn->ssl, len);
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        if(conn->cur_hostname)
+          net_timed_out(conn->cur_hostname, written > 0, get_monotonic_ms() - start);
+        resp->error_message = "Timed out\n";
+      }
       break;
     }
-  } while (len > 0 || BIO_should_retry(gem_tls->bio_web));
+  } while (len > 0 || BIO_should_retry(conn->bio_web));
+
+  if(conn->cur_hostname)
+    hoststats_add_transfer(conn->cur_hostname, written, get_monotonic_ms() - start);
 
   BUF_MEM *bptr = NULL;
-  if(BIO_get_mem_ptr(gem_tls->bio_mem, &bptr) < 0 || bptr == NULL || bptr->length <= 0 || bptr->data == NULL)
+  if(BIO_get_mem_ptr(conn->bio_mem, &bptr) < 0 || bptr == NULL || bptr->length <= 0 || bptr->data == NULL)
     return 0;
 
   char *res = malloc(bptr->length + 1);
@@ -627,6 +715,58 @@ int tls_read(struct gemini_tls *gem_tls, struct response *resp) {
 }
 
 
+int tls_upload_file(struct gemini_conn *conn, int fd, size_t size, tls_progress_func progress, void *arg, struct response *resp) {
+  size_t sent = 0;
+  long page_size = sysconf(_SC_PAGESIZE);
+  assert(UPLOAD_WINDOW % page_size == 0);
+  // for a write that doesn't go anywhere, the same as between two reads
+  struct timeval tv = conn->cur_hostname ? hoststats_read_timeout(conn->cur_hostname) : (struct timeval) { .tv_sec = 5 };
+  double timeout_ms = tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+  double deadline = get_monotonic_ms() + timeout_ms;
+
+  while(sent < size) {
+    size_t window = size - sent > UPLOAD_WINDOW ? UPLOAD_WINDOW : size - sent;
+    char *map = mmap(NULL, window, PROT_READ, MAP_PRIVATE, fd, sent);
+    if(map == MAP_FAILED) {
+      resp->error_message = "Can't map the file\n";
+      return 0;
+    }
+    madvise(map, window, MADV_SEQUENTIAL);
+
+    for(size_t off = 0; off < window; ) {
+      size_t chunk = window - off > UPLOAD_CHUNK ? UPLOAD_CHUNK : window - off;
+      errno = 0;
+      int len = BIO_write(conn->bio_web, map + off, chunk);
+      if(len <= 0) {
+        bool is_timeout = errno == EAGAIN || errno == EWOULDBLOCK;
+        // the send timeout of the socket ran out, a server that stopped reading isn't waited for forever
+        if(BIO_should_retry(conn->bio_web) && !is_timeout && get_monotonic_ms() < deadline)
+          continue;
+        resp->error_message = tls_get_error(conn->ssl, len);
+        if(is_timeout || get_monotonic_ms() >= deadline) {
+          if(conn->cur_hostname)
+            hoststats_add_timeout(conn->cur_hostname);
+          resp->error_message = "Timed out\n";
+        }
+        munmap(map, window);
+        return 0;
+      }
+      off += len;
+      deadline = get_monotonic_ms() + timeout_ms;
+    }
+
+    // drop the pages we've just sent
+    munmap(map, window);
+    sent += window;
+    if(progress)
+      progress(sent, size, arg);
+  }
+
+  BIO_flush(conn->bio_web);
+  return 1;
+}
+
+
 void check_response(struct response *resp) {
   char *crlf;
   // <STATUS><SPACE><META><CR><LF>, minimal response is 5 bytes
@@ -668,40 +808,13 @@ void check_response(struct response *resp) {
 }
 
 
-void tls_reset(struct gemini_tls *gem_tls) {
-  // (the previous code stopped working since openssl 3.2.0)
-  // it turns out that i shouldn't have been doing just BIO_reset, because it's not 
-  // completely clearing the state
-  // i've read that freeing the bio_web object and initalizing it again is safer.
-  // valgrind seems happy :) 
-  void *ex_data = SSL_get_ex_data(gem_tls->ssl, 0);
-  
-  BIO_ssl_shutdown(gem_tls->bio_web);
-  BIO_free_all(gem_tls->bio_web);
-
-  gem_tls->bio_web = BIO_new_ssl_connect(gem_tls->ctx);
-  if(gem_tls->bio_web == NULL)
-    ERROR_LOG_AND_ABORT("Can't create bio new ssl connect");
-
-  BIO_get_ssl(gem_tls->bio_web, &gem_tls->ssl);
-  if(gem_tls->ssl == NULL)
-    ERROR_LOG_AND_ABORT("Can't get ssl");
-  
-  SSL_set_ex_data(gem_tls->ssl, 0, ex_data);
-
-  //BIO_reset(gem_tls->bio_web);
-  BIO_reset(gem_tls->bio_out);
-  BIO_reset(gem_tls->bio_mem);
-
-  if(gem_tls->cur_hostname != NULL){
-    free(gem_tls->cur_hostname);
-    gem_tls->cur_hostname = NULL;
-  }
-}
-
 void tls_free(struct gemini_tls *gem_tls) {
 
   // clean after yourself :)
+  // the remove callback is called for every cached session, so free the context first
+  if(gem_tls->ctx != NULL)
+    SSL_CTX_free(gem_tls->ctx);
+
   struct session_reuse *tmp_session;
   while(gem_tls->session != NULL) {
     tmp_session = gem_tls->session;
@@ -719,15 +832,7 @@ void tls_free(struct gemini_tls *gem_tls) {
     free(tmp_host);
   }
 
-  if(gem_tls->bio_web != NULL)
-    BIO_free_all(gem_tls->bio_web);
-  if(gem_tls->bio_out != NULL)
-    BIO_free(gem_tls->bio_out);
-  if(gem_tls->bio_mem != NULL)
-    BIO_free(gem_tls->bio_mem);
-  if(gem_tls->ctx != NULL)
-    SSL_CTX_free(gem_tls->ctx);
-
+  pthread_mutex_destroy(&gem_tls->lock);
   free(gem_tls);
 
 }
@@ -751,12 +856,14 @@ void tls_free(struct gemini_tls *gem_tls) {
 //  if(gem_tls == NULL) return -1;
 //
 //  for(int i = 2; i < argc; i++) {
-//    tls_connect(gem_tls, argv[i], resp); 
-////      int tmp = tls_read(gem_tls, resp);
+//    char fingerprint[100];
+//    struct gemini_conn *conn = tls_conn_new(gem_tls);
+//    tls_connect(conn, argv[i], resp, fingerprint); 
+////      int tmp = tls_read(conn, resp);
 //      printf("%s\n\n\n", resp->body);
 //      if(resp->error_message)
 //        printf("%s", resp->error_message);
-//      tls_reset(gem_tls);
+//      tls_conn_free(conn);
 //  }
 //
 //  tls_free(gem_tls);
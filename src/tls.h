@@ -45,23 +45,39 @@ struct response {
   enum tofu_check_results cert_result;
   enum response_status_codes status_code;
   bool was_resumpted;
+  // the body is mmap'd from the cache (this many bytes), it's unmapped, not freed
+  size_t mapped_size;
 };
 
+void response_free(struct response *resp);
 
+
+// shared between all requests (SSL_CTX, known hosts, sessions), safe to use from many threads
 typedef struct gemini_tls *Gemini_tls;
+// one request, owned by a single thread at a time
+typedef struct gemini_conn *Gemini_conn;
 
 // getters
-struct known_host *gem_tls_get_known_hosts(struct gemini_tls *gem_tls);
-char *gem_tls_get_cur_hostname(struct gemini_tls *gem_tls);
+char *gem_tls_get_cur_hostname(struct gemini_conn *conn);
 
 Gemini_tls init_tls(uint32_t flag);
-void check_response(struct response *resp);
-int tls_connect(Gemini_tls gem_tls, const char *h, struct response *resp, char fingerprint[]);
-int tls_read(Gemini_tls gem_tls, struct response *resp);
-void tls_reset(Gemini_tls gem_tls);
 void tls_free(struct gemini_tls *gem_tls);
 
+Gemini_conn tls_conn_new(Gemini_tls gem_tls);
+void tls_conn_free(struct gemini_conn *conn);
+
+void check_response(struct response *resp);
+int tls_connect(Gemini_conn conn, const char *h, struct response *resp, char fingerprint[]);
+int tls_read(Gemini_conn conn, struct response *resp);
+// trust the new fingerprint of the host the conn is connected to
+void tls_trust_cert(Gemini_conn conn, char fingerprint[]);
+
+// titan: after tls_connect with a titan:// url, stream size bytes of the file through the connection
+// the response is then read with tls_read
+typedef void (*tls_progress_func)(size_t sent, size_t total, void *arg);
+int tls_upload_file(Gemini_conn conn, int fd, size_t size, tls_progress_func progress, void *arg, struct response *resp);
+
 // helper
-int parse_url(const char **error_message, char *hostname, char **host_resource, char port[6]);
+int parse_url(const char **error_message, char *hostname, char **host_resource, char port[6], const char *default_port);
 
 #endif
@@ -5,6 +5,8 @@ enum tofu_check_results {
   TOFU_OK,
   TOFU_NEW_HOSTNAME,
   TOFU_FINGERPRINT_MISMATCH,
+  // plain TCP protocols (spartan, finger, gopher) have nothing to check
+  TOFU_NO_TLS,
 };
 
 struct known_host;
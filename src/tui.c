@@ -1,32 +1,50 @@
 #include <ncurses.h>
-#include <form.h>
-#include <panel.h>
 #include <string.h>
 #include <locale.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <wctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "tls.h"
 #include "page.h"
 #include "bookmarks.h"
 #include "util.h"
 #include "utf8.h"
+#include "fetch.h"
+#include "hoststats.h"
+#include "gemtext.h"
+#include "layout.h"
+#include "pool.h"
+#include "search.h"
+#include "render.h"
+#include "lineedit.h"
+#include "history.h"
+#include "cache.h"
 
 #define set_main_win_x(max_x) main_win_x = max_x - offset_x - 1
 #define set_main_win_y(max_y) main_win_y = max_y - search_bar_height - info_bar_height - 1 - 1
 
 #define SAVED_DIR "saved/"
 #define MAIN_GEM_SITE "warmedal.se/~antenna/"
+// resizes closer to each other than this are one resize
+#define RESIZE_SETTLE_MS 50
+// how often the progress of a page laid out in the background is shown
+#define LAYOUT_POLL_MS 50
+// how many screens of the page the pad (-p) holds
+#define PAD_SCREENS 4
+// wheel steps closer to each other than this speed it up (-a), up to WHEEL_MAX_SPEED times
+#define WHEEL_BURST_MS 40
+#define WHEEL_MAX_SPEED 5
 
 typedef void (*println_func_def) (WINDOW *, struct screen_line*, int x, int y);
 
 WINDOW *main_win, *search_bar_win, *info_bar_win, *mode_win, *isbookmarked_win;
-PANEL  *dialog_panel; 
 WINDOW *dialog_win, *dialog_subwin, *dialog_title_win;
-FIELD  *search_field[3];
-FORM   *search_form;
+// the url bar, the prompts are in it too
+struct lineedit url_bar;
 
 const int search_bar_height = 1;
 const int info_bar_height = 1;
@@ -44,26 +62,34 @@ char *dialog_message = NULL;
 char **bookmarks_links = NULL;
 int num_bookmarks_links = 0;
 
-enum element {SEARCH_FORM, MAIN_WINDOW, BOOKMARKS_DIALOG};
+enum element {SEARCH_FORM, MAIN_WINDOW, BOOKMARKS_DIALOG, OUTLINE_DIALOG};
 enum element current_focus = MAIN_WINDOW;
 
 enum mode {SCROLL_MODE, LINKS_MODE};
 enum mode current_mode = SCROLL_MODE;
 bool is_offline = false;
-
-enum color {LINK_COLOR = 1, H1_COLOR = 2, H2_COLOR = 3, H3_COLOR = 4, QUOTE_COLOR = 5, DIALOG_COLOR = 6};
-
-enum protocols {HTTPS, HTTP, GOPHER, MAIL, FINGER, SPARTAN, GEMINI, null};
-enum dialog_types {BOOKMARKS, INFO, OFFLINE} current_dialog_type;
-
-const char *protocols_strings[] = {
-  [HTTPS] = " [https]",
-  [HTTP] = " [http]",
-  [GOPHER] = " [gopher]",
-  [MAIL] = " [mail]",
-  [FINGER] = " [finger]",
-  [SPARTAN] = " [spartan]",
-};
+// the numbers of the links on the screen are shown, and typed to select one
+bool is_link_hints_shown = false;
+int typed_link_number = 0;
+// the text found in the page, it's highlighted everywhere it's shown
+struct search page_search;
+// in the response body, a new page is searched from its screen
+const char *search_match = NULL;
+
+// with -p the page isn't printed into main_win, but into a pad a few screens tall,
+// scrolling only changes which of its rows are shown, so a line is printed once when the
+// pad gets to it, not on every step it's scrolled by
+struct {
+  WINDOW *win;
+  // the lines [first, first + rows_num) of the page are printed in its rows from 0
+  int first, rows_num;
+  // the row at the top of the screen
+  int row;
+} page_pad;
+bool is_pad_used = false;
+bool is_wheel_accelerated = false;
+
+enum dialog_types {BOOKMARKS, INFO, OFFLINE, OUTLINE} current_dialog_type;
 
 const char yes_no_options[] = {'y', 'n', '\0'};
 bool is_dialog_hidden = true;
@@ -71,45 +97,42 @@ bool is_dialog_hidden = true;
 struct page_t bookmarks;
 struct page_t offline;
 struct page_t offline_dirs;
+// the headings of the page, one "link" per heading
+struct page_t outline;
 
 char offline_path[PATH_MAX + 1] = {0};
 
-// TODO ?
-//struct gemini_history {
-//  struct {
-//    struct page_t **gem_sites;
-//    int index;
-//    int size;
-//  } content_cache;
-//  
-//  struct {
-//    char **urls;
-//    int size;
-//  } url_history;
-//};
-
-//struct history_list_t {
-//  struct {
-//    struct page_t page;
-//    char *body;
-//  } *current_page, *next_page, *prev_page;
-//} history_list;
-
-struct history_list_t *history_list;
-
+// only the windows that changed, nothing if none of them did,
+// every frame goes through here, nothing else refreshes a window
 static void refresh_windows() {
-  if(wnoutrefresh(info_bar_win)     == ERR) goto err;
-  if(wnoutrefresh(mode_win)         == ERR) goto err;
-  if(wnoutrefresh(main_win)         == ERR) goto err;
-  if(wnoutrefresh(isbookmarked_win) == ERR) goto err;
-  if(wnoutrefresh(search_bar_win)   == ERR) goto err;
-
-  doupdate();
-  return;
-
-err: 
-  fprintf(stderr, "%s", "Can't refresh window\n");
-  exit(EXIT_FAILURE);
+  // the borders are on stdscr, under the others, the url bar is the last one, it has the cursor
+  WINDOW *wins[9];
+  int wins_num = 0;
+  wins[wins_num++] = stdscr;
+  wins[wins_num++] = info_bar_win;
+  wins[wins_num++] = mode_win;
+  wins[wins_num++] = main_win;
+  wins[wins_num++] = isbookmarked_win;
+  if(!is_dialog_hidden) {
+    // it's over the page, so it's copied again if the page was
+    if(is_wintouched(stdscr) || is_wintouched(main_win))
+      touchwin(dialog_win);
+    wins[wins_num++] = dialog_win;
+    wins[wins_num++] = dialog_title_win;
+    wins[wins_num++] = dialog_subwin;
+  }
+  wins[wins_num++] = search_bar_win;
+
+  // the dialog would be drawn over
+  if(page_pad.win && is_dialog_hidden) {
+    struct render_pad pad = {
+      page_pad.win, page_pad.row, 
+      search_bar_height + 1, 0, search_bar_height + main_win_y, max_x - 1 - offset_x
+    };
+    render_frame(wins, wins_num, &pad);
+  }
+  else
+    render_frame(wins, wins_num, NULL);
 }
 
 // ########## INITIALIZATION ##########
@@ -128,6 +151,8 @@ static void init_colors() {
   init_pair(QUOTE_COLOR, COLOR_BLACK, COLOR_WHITE);
   // dialog borders
   init_pair(DIALOG_COLOR, COLOR_RED, COLOR_BLACK);
+  // found text
+  init_pair(SEARCH_COLOR, COLOR_BLACK, COLOR_YELLOW);
 }
 
 static void init_dialog_panel() {
@@ -143,12 +168,23 @@ static void init_dialog_panel() {
 
   box(dialog_win, 0, 0);
   keypad(dialog_win, true);
+  leaveok(dialog_win, true);
+  leaveok(dialog_subwin, true);
+  leaveok(dialog_title_win, true);
 
-  dialog_panel = new_panel(dialog_win);
   is_dialog_hidden = true;
-  hide_panel(dialog_panel);
-  update_panels();
-  doupdate();
+}
+
+// the last column is the scrollbar's, it stays in main_win
+static void init_page_pad() {
+  if(page_pad.win)
+    delwin(page_pad.win);
+  page_pad.win = newpad(PAD_SCREENS * main_win_y, max_x - offset_x);
+  if(!page_pad.win)
+    ERROR_LOG_AND_EXIT("Can't create the pad");
+  idlok(page_pad.win, true);
+  leaveok(page_pad.win, true);
+  page_pad.first = page_pad.rows_num = page_pad.row = 0;
 }
 
 static void init_windows() {
@@ -163,7 +199,9 @@ static void init_windows() {
   set_main_win_y(max_y);
   
   main_win = newwin(main_win_y, max_x, search_bar_height + 1, 0);
-  scrollok(main_win, true);
+  // scrolled only by render_scroll, with the terminal's own scrolling
+  scrollok(main_win, false);
+  idlok(main_win, true);
   keypad(main_win, true);
   
   search_bar_win = newwin(search_bar_height, max_x - 2, 0, 0);
@@ -172,102 +210,34 @@ static void init_windows() {
   
   info_bar_win = newwin(info_bar_height, max_x - 6, max_y - 1, 0);  
   mode_win = newwin(1, 5, max_y - 1, max_x - 5);
+  // the cursor is only shown in the url bar, the others don't move it
+  leaveok(stdscr, true);
+  leaveok(main_win, true);
+  leaveok(isbookmarked_win, true);
+  leaveok(info_bar_win, true);
+  leaveok(mode_win, true);
 
   init_colors();
-  refresh();  
-}
-
-static void init_search_form(bool resize) {
-  // search_field[0] is a static field so we need to create it only once 
-  if(!resize) {
-    // coords are relative to the window
-    // [0]
-    search_field[0] = new_field(search_bar_height, 6, 0, 0, 0, 0);
-    field_opts_off(search_field[0], O_EDIT);
-    set_field_opts(search_field[0], O_VISIBLE | O_PUBLIC | O_AUTOSKIP);
-    set_field_buffer(search_field[0], 0, "url:");
-    // [2]
-    search_field[2] = NULL;
-  }
-  // [1]
-  search_field[1] = new_field(search_bar_height, max_x - 6 - 2, 0, 6, 0, 0);
-  
-  set_field_back(search_field[1], A_UNDERLINE);
-  set_field_opts(search_field[1], O_VISIBLE | O_PUBLIC | O_ACTIVE | O_EDIT);
-  // 1024 is max url length
-  set_max_field(search_field[1], 1024);
-  field_opts_off(search_field[1], O_STATIC);
+  render_init();
+  if(is_pad_used)
+    init_page_pad();
+}
 
-  search_form = new_form(search_field);
-  set_form_win(search_form, search_bar_win);
-  set_form_sub(search_form, derwin(search_bar_win, search_bar_height, max_x - 2, 0, 0));
-  post_form(search_form);
+static void init_url_bar() {
+  // the label is as wide as "input:"
+  lineedit_init(&url_bar, search_bar_win, 6);
+  lineedit_set_label(&url_bar, "url:");
 }
 
 // ########## FREEING ##########
 
 void free_windows() {
-  if(search_form) {
-    unpost_form(search_form);
-    free_form(search_form);
-  }
-  if(search_field[0])
-    free_field(search_field[0]);
-  if(search_field[1])  
-    free_field(search_field[1]); 
-  
+  if(page_pad.win)
+    delwin(page_pad.win);
+  render_free();
   endwin();
 }
 
-static void free_lines(struct page_t *page) {
-  
-  for(int i = 0; i < page->lines_num; i++) {
-    if(page->lines[i]) {
-      free(page->lines[i]->text);
-      
-      if(page->lines[i]->link != NULL) {
-        char *p = page->lines[i]->link;
-        int j = 0;
-        free(p);
-
-        // the  next line may have the same link pointer so take care of it
-        while(i + j < page->lines_num) {
-          if(page->lines[i + j]->link == p) {
-            page->lines[i + j]->link = NULL;
-            j++;
-          }
-          else {
-            break;
-          }
-        }
-      }
-
-      free(page->lines[i]);
-     }
-  }
-  free(page->lines);
-  page->lines = NULL;
-}
-
-static void free_paragraphs(char **paragraphs, int paragraphs_num) {
-  for(int i = 0; i < paragraphs_num; i++)
-    if(paragraphs[i])
-      free(paragraphs[i]);
- 
-  free(paragraphs);
-}
-
-static void free_resp(struct response *resp) {
-  if(resp != NULL) {
-    if(resp->body)
-      free(resp->body);
-    if(resp->meta)
-      free(resp->meta);
-    free(resp);
-  }
-  resp = NULL;
-}
-
 // ########## DRAWING ##########
 
 static void draw_borders() {
@@ -278,30 +248,98 @@ static void draw_borders() {
 }
 
 static void draw_scrollbar(WINDOW *win, struct page_t *page, int page_y, int page_x) {
-  if(page->lines_num <= 0) return;
+  // the page may not be measured to the end yet
+  int lines_num = layout_lines_estimate(page);
+  if(lines_num <= 0) return;
 
   double y;
-  double scrollbar_height = (double)((page_y) * (page_y)) / (double)page->lines_num;
+  double scrollbar_height = (double)((page_y) * (page_y)) / (double)lines_num;
   if(scrollbar_height < 1.0)
     scrollbar_height = 1.0;
 
   if(page->first_line_index == 0) {
     y = 0;
   } 
-  else if(page->last_line_index == page->lines_num) {
+  else if(page->last_line_index == lines_num) {
     if(scrollbar_height != 1.0)
       y = (double)(page_y + 1 - scrollbar_height);
     else
       y = (double)(page_y - scrollbar_height);
   }
   else {
-    y = (double)(page->first_line_index + 1) / (double)page->lines_num;
+    y = (double)(page->first_line_index + 1) / (double)lines_num;
     y = page_y * y;
     y = (int)(y + 0.5);
   }
 
-  mvwvline(win, 0, page_x, ' ', page_y);
-  mvwvline(win, y, page_x, 0, scrollbar_height);
+  // it's drawn every frame, so only the cells that are different are touched,
+  // otherwise a frame where nothing happened isn't idle
+  int thumb_start = (int)y, thumb_end = (int)y + (int)scrollbar_height;
+  for(int row = 0; row < page_y; row++) {
+    chtype ch = (row >= thumb_start && row < thumb_end) ? ACS_VLINE : ' ';
+    chtype shown = mvwinch(win, row, page_x) & (A_CHARTEXT | A_ALTCHARSET);
+    if(shown != (ch & (A_CHARTEXT | A_ALTCHARSET)))
+      mvwaddch(win, row, page_x, ch);
+  }
+}
+
+// ########## PAD ##########
+
+// what's printed into main_win goes to the pad instead
+static inline bool is_padded(WINDOW *win) {
+  return win == main_win && page_pad.win != NULL;
+}
+
+// the screen from `first` has to be in the pad, when it goes out of it, it's scrolled 
+// (or printed again after a jump), so it starts a screen above the screen,
+// the lines the pad doesn't have are printed up to a screen under the screen,
+// so the next steps have them
+static void pad_show(struct page_t *page, int first, int page_y, println_func_def print_func) {
+  int pad_y = getmaxy(page_pad.win);
+  if(first < page_pad.first || first + page_y > page_pad.first + pad_y) {
+    int pad_first = first > page_y ? first - page_y : 0;
+    int shift = pad_first - page_pad.first;
+    if(abs(shift) >= pad_y || page_pad.rows_num == 0) {
+      werase(page_pad.win);
+      page_pad.rows_num = 0;
+    }
+    else {
+      scrollok(page_pad.win, true);
+      wscrl(page_pad.win, shift);
+      scrollok(page_pad.win, false);
+      if(shift > 0) {
+        page_pad.rows_num = page_pad.rows_num > shift ? page_pad.rows_num - shift : 0;
+      }
+      else {
+        // the lines above it are printed into the rows that came in at the top
+        for(int row = 0; row < -shift; row++)
+          print_func(page_pad.win, page_line(page, pad_first + row), offset_x, row);
+        page_pad.rows_num = page_pad.rows_num - shift < pad_y ? page_pad.rows_num - shift : pad_y;
+      }
+    }
+    page_pad.first = pad_first;
+  }
+
+  int end = first + 2 * page_y;
+  if(end > page_pad.first + pad_y)
+    end = page_pad.first + pad_y;
+  int lines_num = layout_ensure_lines(page, end);
+  for(int index = page_pad.first + page_pad.rows_num; index < end && index < lines_num; index++) {
+    print_func(page_pad.win, page_line(page, index), offset_x, index - page_pad.first);
+    page_pad.rows_num++;
+  }
+
+  page_pad.row = first - page_pad.first;
+  page->first_line_index = first;
+  page->last_line_index = first + page_y < lines_num ? first + page_y : lines_num;
+}
+
+// everything printed into it is gone, e.g. for a new page
+static void pad_print(struct page_t *page, int first, int page_y, println_func_def print_func) {
+  werase(page_pad.win);
+  page_pad.first = first > page_y ? first - page_y : 0;
+  page_pad.rows_num = 0;
+  pad_show(page, first, page_y, print_func);
 }
 
 // ########## STRINGS ##########
@@ -333,273 +371,42 @@ static inline int m_strncmp(char *a, const char *b) {
   return strncmp(a, b, strlen(b));
 }
 
-// we get a string and we cut it to equal parts, which are terminal width
-// so every line is indepenent 
-static char **string_to_paragraphs(char *str, int *paragraphs_num) {
-  int i = 0, num_newlines = 0;
-  // count new paragraphs to know how many gemini_paragraph to allocate
-  while(str[i] != '\0') {
-    if(str[i] == '\n') {
-      num_newlines++;
-    }
-    i++;
-  }
-  
-  char **paragraphs = (char **) calloc(1, num_newlines * sizeof(char*));
-
-  char *str_tmp = str, *str_start = str;
-  int index_line = 0;
-  // fill paragraphs array
-  while(*str_tmp != '\0') {
-    if(*str_tmp == '\n') {
-      paragraphs[index_line] = strndup(str_start, str_tmp - str_start);
-      index_line++;
-      str_start = str_tmp + 1;
-    }
-    str_tmp++;
-  }
-
-  // remainder paragraph if the body doesn't end with \n
-  if(str_tmp > str_start) {
-    num_newlines++; 
-    paragraphs = realloc(paragraphs, num_newlines * sizeof(char*));
-    paragraphs[index_line] = strndup(str_start, str_tmp - str_start);
-  }
+// ########## BOOKMARKS ##########
 
-  *paragraphs_num = num_newlines;
-
-  return paragraphs;
-}
+// there's only a few bookmarks, so they're laid out again on every change
+static void relayout_bookmarks(bool keep_selected) {
+  int old_lines_num = bookmarks.lines_num;
+  int old_index = bookmarks.selected_link_index;
 
-static enum protocols get_protocol(char *str) {
-  
-  enum protocols protocol = null;
-
-  if(m_strncmp(str, "gemini://") == 0 || m_strncmp(str, "//") == 0)
-    protocol = GEMINI;
-  else if(m_strncmp(str, "https://") == 0)
-    protocol = HTTPS;
-  else if(m_strncmp(str, "http://") == 0)
-    protocol = HTTP;
-  else if(m_strncmp(str, "gopher://") == 0)
-    protocol = GOPHER;
-  else if(m_strncmp(str, "mailto:") == 0)
-    protocol = MAIL;
-  else if(m_strncmp(str, "finger://") == 0)
-    protocol = FINGER;
-  else if(m_strncmp(str, "spartan://") == 0)
-    protocol = SPARTAN;
-
-  return protocol;
-}
-
-static int get_paragraph_attr(char **paragraph, char **link, enum protocols *protocol, int *p_offset) {
-  
-  unsigned int attr = A_NORMAL;
-  int offset = 0;
-  if(strlen(*paragraph) > 0) {
-
-    if(m_strncmp(*paragraph, "###") == 0) {
-      attr |= A_BOLD | A_ITALIC;
-      attr |= COLOR_PAIR(H3_COLOR);
-      offset = 3;
-    }
-    else if(m_strncmp(*paragraph, "##") == 0) {
-      attr |= A_BOLD | A_ITALIC;
-      attr |= COLOR_PAIR(H2_COLOR);
-      offset = 2;
-    }
-    else if(m_strncmp(*paragraph, "#") == 0) {
-      attr |= A_BOLD;
-      attr |= COLOR_PAIR(H1_COLOR);
-      offset = 1;
-    }
-    else if(m_strncmp(*paragraph, ">") == 0) {
-      attr |= A_ITALIC;
-      attr |= COLOR_PAIR(QUOTE_COLOR);
-      offset = 1;
-    }
-    else if(m_strncmp(*paragraph, "=>") == 0) {
-      
-      // Lines beginning with the two characters "=>" are link lines, which have the following syntax:
-      // =>[<whitespace>]<URL>[<whitespace><USER-FRIENDLY LINK NAME>]
-      attr |= A_UNDERLINE;
-      attr |= COLOR_PAIR(LINK_COLOR);
-      offset = 2;
-      char *paragraph_end = NULL;
-      char *link_start = *paragraph + 2;
-
-      // skip the first whitespace
-      while(*link_start != '\0' && isspace(*link_start)) {
-        link_start++;
-        offset++;
-      }
+  layout_free(&bookmarks);
+  bookmarks.selected_link_index = -1;
+  if(bookmarks_links == NULL)
+    return;
 
-      *protocol = get_protocol(link_start);
+  layout_links(
+      &bookmarks, 
+      bookmarks_links, 
+      num_bookmarks_links, 
+      dialog_subwin_x - offset_x
+  );
 
-      // go throught the URL
-      paragraph_end = link_start;
-      while(*paragraph_end != '\0' && !isspace(*paragraph_end)) {
-        paragraph_end++;
-        offset++;
-      }
-      
-      // copy the URL
-      if(link_start != paragraph_end) {
-        char *link_p = (char*) calloc(paragraph_end - link_start + 1, sizeof(char));
-        memcpy(link_p, link_start, paragraph_end - link_start);
-        link_p[paragraph_end - link_start] = '\0';
-        *link = link_p;
-      }
-      
-      // skip whitespace(s) after url
-      while(*paragraph_end != '\0' && isspace(*paragraph_end)) {
-        paragraph_end++;
-        offset++;
-      }
-      // if there is no '<USER_FRIENDLY LINK NAME>' then show the plain URL
-      if(*paragraph_end == '\0') {
-        *protocol = null;
-        offset = link_start - *paragraph;
-      }
-      else {
-        // i found out that for some reasons, some links have
-        // a '\r' symbol at the end?
-        // so we need to check this
-        // i suspect it's windows carriage return fault
-        while(*paragraph_end && *paragraph_end != '\r')
-          paragraph_end++;
-        *paragraph_end = '\0';
-      }
-    }
+  if(keep_selected && old_index != -1 && old_index < bookmarks.lines_num) {
+    bookmarks.selected_link_index = old_index;
+    page_line(&bookmarks, old_index)->attr ^= A_STANDOUT;
   }
-  
-  *p_offset = offset;
-
-  return attr;
-}
-
 
-static struct screen_line** paragraphs_to_lines(
-    struct page_t *page, 
-    char **paragraphs, 
-    int paragraphs_num, 
-    int page_x, 
-    // this flag is used in bookmarks
-    bool set_links_to_paragraphs
-) {
-  
-  bool is_preformatted_mode = false;
- 
-  struct screen_line **lines = (struct screen_line**) calloc(1, 1 * sizeof(struct screen_line *));
-  int num_lines = 0;
-  
-  for(int i = 0; i < paragraphs_num; i++) {
-    char *line_str = paragraphs[i], *link = NULL;
-    enum protocols protocol = null; 
-    int offset_begin = 0;
-    int attr = A_NORMAL;
-
-    bool is_last_line = false;
-    // this flag is used with set_links_to_paragraphs
-    // if we're printing bookmarks, then we need to know which part (domain) should be bolded
-    // so what we do, is we give attr A_BOLD to everything, that's before the slash mark '/' in a url
-    bool make_domain_bold = false;
- 
-    if(m_strncmp(line_str, "```") == 0)
-      is_preformatted_mode = !is_preformatted_mode;
-   
-    if(set_links_to_paragraphs == false) {
-      attr = get_paragraph_attr(&line_str, &link, &protocol, &offset_begin);
-    } 
-    else {
-      link = strdup(paragraphs[i]);
-      make_domain_bold = true;
-    }
-    
-    line_str += offset_begin;
-     
-    // it's a link to non gemini page
-    if(protocol != null && protocol != GEMINI) {
-      // if it's not a gemini protocol we need to append an information to the end of the link
-      // so realloc, add to the end, and set line_str to our reallocated string + offset
-      const char *protocol_str = protocols_strings[protocol];
-      paragraphs[i] = realloc(paragraphs[i], strlen(paragraphs[i]) + strlen(protocol_str) + 1);
-      strcat(paragraphs[i], protocol_str);
-      line_str = paragraphs[i] + offset_begin;
-    }
-    
-    // loop over all lines in a paragraph
-    do {
-      // if at the end of the line we have a splited word
-      // then move the whole word to the next line 
-      int word_offset = 0;
-      //int line_len = utf8_to_bytes(line_str, page_x - offset_x);
-      int line_len = utf8_to_bytes(line_str, utf8_max_chars_in_width(line_str, page_x - offset_x));
-      
-      //if(utf8_max_chars_in_bytes(line_str, strlen(line_str)) <= page_x - offset_x)
-      if(utf8_strwidth(line_str) <= page_x - offset_x)
-        is_last_line = true;
-
-      // check if word at the end of the line needs to be moved to the next line
-      char *line_p = line_str, *last_found_space = NULL;
-      if(line_str[line_len] != '\0') {  
-        while(line_p != line_str + line_len) {
-          line_p += utf8_to_bytes(line_p, 1);
-          if(iswspace(get_wchar(line_p)))
-            last_found_space = line_p;
-        }
-
-        if(last_found_space != NULL) {
-          // word offset in *raw bytes*
-          word_offset = (line_str + line_len) - last_found_space;
-          // if we have one long line then let it be split, otherwise move 
-          if(utf8_strnwidth(last_found_space, utf8_max_chars_in_bytes(last_found_space, word_offset)) > (page_x - offset_x) / 2) {
-            word_offset = 0;
-          }
-        }
-      }
-     
-      line_len -= word_offset; 
-      
-      if(*line_str != '\0' && iswspace(get_wchar(line_str)) && is_preformatted_mode == false) {
-        line_str++;
-        line_len--;
-      }
-    
-      num_lines++;
-      lines = realloc(lines, num_lines * sizeof(struct screen_line*));
-
-      char *text = malloc(line_len + 1);
-      memcpy(text, line_str, line_len);
-      text[line_len] = '\0';
-
-      struct screen_line *line = (struct screen_line*) calloc(1, 1 * sizeof(struct screen_line));
-      
-      // it is used for bookmarks_dialog, to know when a domain should be bolded
-      if(make_domain_bold) {
-        line->attr = A_BOLD;
-        if(strchr(text, '/'))
-          make_domain_bold = false;
-      }
-      else {
-        line->attr = attr;
-      }
-      line->text = text;
-      line->link = link;
-      lines[num_lines - 1] = line;
+  // we deleted a bookmark at the end so the screen needs to go down a bit right
+  if(bookmarks.lines_num != 0 && bookmarks.last_line_index > bookmarks.lines_num - 1) {
+    int deleted_lines_num = old_lines_num - bookmarks.lines_num;
+    if(bookmarks.first_line_index - deleted_lines_num >= 0)
+      bookmarks.first_line_index -= deleted_lines_num;
+    else
+      bookmarks.first_line_index = 0;
       
-      line_str += line_len;
-    } while(!is_last_line);
+    bookmarks.last_line_index = bookmarks.lines_num - 1;
   }
-
-  page->lines_num = num_lines;
-  page->selected_link_index = -1;
-
-  return lines;
 }
 
-
 // ########## PRINTING ##########
 
 static void print_current_mode() {
@@ -608,7 +415,6 @@ static void print_current_mode() {
     (is_offline) ? "off" : "on",
     (current_mode == LINKS_MODE) ? 'L' : 'S'
   );
-  wrefresh(mode_win);
 }
 
 static void print_is_bookmarked(bool is_bookmarked) {
@@ -627,7 +433,8 @@ static void info_bar_print(const char *format, ...) {
 
   werase(info_bar_win);
   wprintw(info_bar_win, "%s", info_message);
-  wrefresh(info_bar_win);
+  // it's shown at once, it may be the progress of something that blocks
+  refresh_windows();
 }
 
 static void info_bar_clear(void) {
@@ -635,17 +442,20 @@ static void info_bar_clear(void) {
   werase(info_bar_win);
 }
 
+// a match going over the end of the line isn't highlighted
+static void highlight_matches(WINDOW *win, const char *text, int x, int y) {
+  const char *p = text, *end = text + strlen(text);
+  while((p = search_find(&page_search, p, end - p)) != NULL) {
+    int column = utf8_span_drawn_width(text, p - text, 0);
+    mvwchgat(win, y, x + column, utf8_span_drawn_width(p, page_search.len, column), A_NORMAL, SEARCH_COLOR, NULL);
+    p += page_search.len;
+  }
+}
+
 static void printline(WINDOW *win, struct screen_line *line, int x, int y) {
-  // scrollok scrolls automatically to the next line when 
-  // len == max_x so disable it temporarily
-  scrollok(win, false);
-  wattron(win, line->attr);
-  
-  if(line->text != NULL)
-    mvwprintw(win, y, x, "%s", line->text);
-  
-  wattroff(win, line->attr);
-  scrollok(win, true); 
+  render_line(win, y, x, line);
+  if(line->text != NULL && search_is_active(&page_search))
+    highlight_matches(win, line->text, x, y);
 }
 
 static void print_page(
@@ -655,18 +465,23 @@ static void print_page(
     int page_y,
     println_func_def print_func
     ) {
-  scrollok(win, false);
   // TODO if we resized the window too much and the text on down is now on up
   // then go up to make the text be on down
   int index = first_line_index;
   struct screen_line *line;
   if(!print_func)
     print_func = &printline;
+  if(is_padded(win)) {
+    pad_print(page, first_line_index, page_y, print_func);
+    return;
+  }
+  // only what's going to be shown is laid out
+  layout_ensure_lines(page, first_line_index + page_y);
   // print all we can
   for(int i = 0; i < page_y; i++){
     if(index >= page->lines_num)
       break;
-    line = page->lines[index];
+    line = page_line(page, index);
     print_func(win, line, offset_x, i);
     index++;
   }
@@ -674,13 +489,49 @@ static void print_page(
   assert(index >= 0);
   page->last_line_index = index;
   page->first_line_index = first_line_index;
-  
-  scrollok(win, true);
+}
+
+// the rows that stay on the screen are scrolled (by the terminal) instead of being printed again,
+// only the new ones are printed, a jump of a whole screen or more prints all of them
+static void scroll_page_to(
+    struct page_t *page, 
+    WINDOW *win, 
+    int first_line_index, 
+    int page_y,
+    println_func_def print_func
+    ) {
+  int shift = first_line_index - page->first_line_index;
+  bool is_full = page->last_line_index - page->first_line_index == page_y;
+  if(shift == 0 && is_full)
+    return;
+  if(!print_func)
+    print_func = &printline;
+  if(is_padded(win)) {
+    pad_show(page, first_line_index, page_y, print_func);
+    return;
+  }
+  if(abs(shift) >= page_y || !is_full) {
+    werase(win);
+    print_page(page, win, first_line_index, page_y, print_func);
+    return;
+  }
+
+  layout_ensure_lines(page, first_line_index + page_y);
+  render_scroll(win, shift);
+
+  int first_row = shift > 0 ? page_y - shift : 0;
+  int last_row = shift > 0 ? page_y : -shift;
+  for(int row = first_row; row < last_row && first_line_index + row < page->lines_num; row++)
+    print_func(win, page_line(page, first_line_index + row), offset_x, row);
+
+  page->first_line_index = first_line_index;
+  page->last_line_index = first_line_index + page_y;
+  if(page->last_line_index > page->lines_num)
+    page->last_line_index = page->lines_num;
 }
 
 
 static void print_bookmark_line(WINDOW *win, struct screen_line *line, int x, int y) {
-  scrollok(win, false);
   wattron(win, line->attr);
 
   char *domain = NULL;
@@ -706,7 +557,6 @@ static void print_bookmark_line(WINDOW *win, struct screen_line *line, int x, in
   }
 
   wattroff(win, line->attr);
-  scrollok(win, true); 
 }
 
 static void scrolldown(
@@ -716,13 +566,19 @@ static void scrolldown(
     println_func_def print_func
   ) {
   
-  if(page->last_line_index >= page->lines_num || page->lines == NULL)
+  if(!page_has_lines(page))
     return;
+  if(page->last_line_index >= layout_ensure_lines(page, page->last_line_index + 1))
+    return;
+  if(!print_func) print_func = &printline;  
+  if(is_padded(win)) {
+    pad_show(page, page->first_line_index + 1, page_y, print_func);
+    return;
+  }
   
-  wscrl(win, 1);
+  render_scroll(win, 1);
 
-  struct screen_line *line = page->lines[page->last_line_index];
-  if(!print_func) print_func = &printline;  
+  struct screen_line *line = page_line(page, page->last_line_index);
   print_func(win, line, offset_x, page_y - 1);
 
   page->last_line_index++;
@@ -736,27 +592,70 @@ static void scrollup(
     println_func_def print_func
   ) {
   
-  if(page->first_line_index == 0 || page->lines == NULL)
+  if(page->first_line_index == 0 || !page_has_lines(page))
     return;
+  if(!print_func) print_func = &printline;  
+  if(is_padded(win)) {
+    pad_show(page, page->first_line_index - 1, main_win_y, print_func);
+    return;
+  }
 
-  wscrl(win, -1);
+  render_scroll(win, -1);
   
   page->first_line_index--;
   page->last_line_index--;
 
-  struct screen_line *line = page->lines[page->first_line_index];
-  if(!print_func) print_func = &printline;  
+  struct screen_line *line = page_line(page, page->first_line_index);
   print_func(win, line, offset_x, 0);
 }
 
 
+// dragging a tmux pane border sends dozens of resizes, only the last size is laid out
+static void wait_for_last_resize(void) {
+  int ch;
+  timeout(RESIZE_SETTLE_MS);
+  while((ch = getch()) == KEY_RESIZE)
+    ;
+  timeout(-1);
+  if(ch != ERR)
+    ungetch(ch);
+}
+
+// the rest of a big page is measured on the layout's worker, here it's only shown what it did,
+// the screen isn't blocked, everything measured so far can be scrolled,
+// returns true while it's still working
+static bool poll_layout(struct page_t *page, bool is_shown) {
+  static bool was_laying_out = false;
+  int percent;
+  int lines_num = page->lines_num;
+  bool is_laying_out = layout_poll(page, &percent);
+
+  if(is_shown) {
+    // the screen ended with the measured part, so the new lines go under it
+    if(page->lines_num > lines_num && page->last_line_index - page->first_line_index < main_win_y)
+      print_page(page, main_win, page->first_line_index, main_win_y, NULL);
+
+    // info_message stays as it is, it's shown again when it's done
+    if(is_laying_out) {
+      werase(info_bar_win);
+      wprintw(info_bar_win, "Laying out... %d%%", percent);
+    }
+    else if(was_laying_out) {
+      werase(info_bar_win);
+      wprintw(info_bar_win, "%s", info_message);
+    }
+  }
+  was_laying_out = is_laying_out;
+  return is_laying_out;
+}
+
 // this function is bulk, i know, but just freeing and initializing everythink again
 // has a huge memory and performance impact.
 // we need to resize and move windows manually i guess, or make some sort of functions to do what
 static void resize_screen(struct page_t *page, struct response *resp) {
 
-  endwin();
-  refresh();
+  // ncurses has resized stdscr already, the next frame is drawn from scratch
+  clearok(curscr, true);
   getmaxyx(stdscr, max_y, max_x);
 
   if(max_y <= 5 || max_x <= 5) {
@@ -780,6 +679,7 @@ static void resize_screen(struct page_t *page, struct response *resp) {
 
   // search_bar win
   wresize(search_bar_win, 1, max_x - 2);
+  lineedit_resize(&url_bar);
   
   // bookmarked win
   mvwin(isbookmarked_win, 0, max_x - 1);
@@ -789,47 +689,20 @@ static void resize_screen(struct page_t *page, struct response *resp) {
   wresize(main_win, main_win_y, max_x);
   draw_borders();
   wclear(main_win);
-
-  // search win
-  form_driver(search_form, REQ_VALIDATION);
-  char search_str[1024];
-  bool is_search_field_str = false;
-  if(field_buffer(search_field[1], 0) != NULL){
-    strcpy(search_str, trim_whitespaces(field_buffer(search_field[1], 0)));
-    is_search_field_str = true;
-  }
-  
-  // form
-  // unfortunately there's no way to just resize a form, we need to recreate it
-  unpost_form(search_form);
-  free_form(search_form);
-  free_field(search_field[1]);
-  
-  init_search_form(true);
-  if(is_search_field_str)
-    set_field_buffer(search_field[1], 0, search_str);
+  if(page_pad.win)
+    init_page_pad();
 
   // main win
-  // set selected link to index -1, to start from the beginning of the page 
-  page->selected_link_index = -1;
   // if there was a response, then print it
-  if(page->lines != NULL)
-    free_lines(page);
-
   if(!is_offline) { 
     if(resp && resp->body) {
-      int paragraphs_num = 0;
-      char **paragraphs = string_to_paragraphs(resp->body, &paragraphs_num);
-      page->lines = paragraphs_to_lines(
-          page, 
-          paragraphs, 
-          paragraphs_num, 
-          main_win_x, 
-          false
-      );
-      
-      free_paragraphs(paragraphs, paragraphs_num);
-      print_page(page, main_win, 0, main_win_y, NULL);
+      // the page is already parsed, only lay it out again (or take the layout for this width)
+      // and stay where we were
+      layout_resize(page, main_win_x - offset_x);
+      int first_line_index = page->first_line_index;
+      if(layout_ensure_lines(page, first_line_index + main_win_y) < first_line_index + main_win_y)
+        first_line_index = page->lines_num > main_win_y ? page->lines_num - main_win_y : 0;
+      print_page(page, main_win, first_line_index, main_win_y, NULL);
     }
   }
   // TODO
@@ -838,7 +711,6 @@ static void resize_screen(struct page_t *page, struct response *resp) {
   // dialog panel
   wclear(dialog_win);
   wclear(dialog_subwin);
-  refresh_windows();
   
   int d_win_pos_y = max_y / 8.0;
   int d_win_pos_x = max_x / 8.0;
@@ -857,27 +729,17 @@ static void resize_screen(struct page_t *page, struct response *resp) {
   mvwin(dialog_subwin, d_win_pos_y + 3, d_win_pos_x + 1);
   mvwin(dialog_title_win, 1, 1);
 
-  replace_panel(dialog_panel, dialog_win);
-  
   box(dialog_win, 0, 0);
   mvwhline(dialog_title_win, 1, 0, 0, dialog_subwin_x + 2);
   
-  if(bookmarks.lines) {
-    free_lines(&bookmarks);
-    bookmarks.lines = paragraphs_to_lines(
-      &bookmarks, 
-      bookmarks_links, 
-      num_bookmarks_links, 
-      dialog_subwin_x, 
-      true
-    );
-  }
+  if(page_has_lines(&bookmarks))
+    layout_resize(&bookmarks, dialog_subwin_x - offset_x);
   
   switch(current_dialog_type){
     case BOOKMARKS:
       mvwprintw(dialog_title_win, 0, dialog_subwin_x / 2 - 4, "%s", "Bookmarks");
-      if(bookmarks.lines)
-        print_page(&bookmarks, dialog_subwin, 0, dialog_subwin_y, &print_bookmark_line);
+      if(page_has_lines(&bookmarks))
+        print_page(&bookmarks, dialog_subwin, bookmarks.first_line_index, dialog_subwin_y, &print_bookmark_line);
       draw_scrollbar(dialog_subwin, &bookmarks, dialog_subwin_y, dialog_win_x - 2 - offset_x);
       break;
     case INFO:
@@ -887,14 +749,21 @@ static void resize_screen(struct page_t *page, struct response *resp) {
       break;
     case OFFLINE: 
       mvwprintw(dialog_title_win, 0, dialog_subwin_x / 2 - 3, "%s", "Offline");
-      if(offline.lines)
+      if(page_has_lines(&offline))
         print_page(&offline, dialog_subwin, 0, dialog_subwin_y, NULL);
       draw_scrollbar(dialog_subwin, &offline, dialog_subwin_y, dialog_win_x - 2 - offset_x);
       break;
+    case OUTLINE:
+      mvwprintw(dialog_title_win, 0, dialog_subwin_x / 2 - 3, "%s", "Outline");
+      if(page_has_lines(&outline)) {
+        layout_resize(&outline, dialog_subwin_x - offset_x);
+        print_page(&outline, dialog_subwin, outline.first_line_index, dialog_subwin_y, NULL);
+      }
+      draw_scrollbar(dialog_subwin, &outline, dialog_subwin_y, dialog_win_x - 2 - offset_x);
+      break;
   }
   
-  update_panels();
-  doupdate();
+  refresh_windows();
 }
 
 static void reprint_line(
@@ -905,10 +774,17 @@ static void reprint_line(
     println_func_def print_func
     ) {
 
+  // a line the pad doesn't have yet is printed when it gets to it
+  if(is_padded(win)) {
+    win = page_pad.win;
+    offset = index - page_pad.first;
+    if(offset < 0 || offset >= page_pad.rows_num)
+      return;
+  }
   wmove(win, offset, 0);
   wclrtoeol(win);
   if(!print_func) print_func = &printline;
-  print_func(win, page->lines[index], offset_x, offset);
+  print_func(win, page_line(page, index), offset_x, offset);
 }
 
 
@@ -918,6 +794,8 @@ static void pagedown(
     int page_y,
     println_func_def print_func
     ) {
+  // the next page has to be measured to know if it's the last one
+  layout_ensure_lines(page, page->last_line_index + page_y);
   if(page->lines_num > page_y) {
     int start_line = 0;
     if(page->last_line_index + page_y > page->lines_num)
@@ -925,8 +803,7 @@ static void pagedown(
     else
       start_line = page->last_line_index;
   
-    werase(win);
-    print_page(page, win, start_line, page_y, print_func);
+    scroll_page_to(page, win, start_line, page_y, print_func);
   }
 }
 
@@ -944,60 +821,180 @@ static void pageup(
     else
       start_line_index = page->first_line_index - page_y;
 
-    werase(win);
-    print_page(page, win, start_line_index, page_y, print_func);
+    scroll_page_to(page, win, start_line_index, page_y, print_func);
   }
 }
 
 
-static void nextlink(
+// with -a a spun wheel goes faster the faster it's spun
+static int wheel_lines(void) {
+  static double last_ms = 0;
+  static int speed = 1;
+  if(!is_wheel_accelerated)
+    return scrolling_velocity;
+
+  double now_ms = get_monotonic_ms();
+  if(now_ms - last_ms < WHEEL_BURST_MS)
+    speed = speed < WHEEL_MAX_SPEED ? speed + 1 : WHEEL_MAX_SPEED;
+  else
+    speed = 1;
+  last_ms = now_ms;
+  return scrolling_velocity * speed;
+}
+
+// lines a key (or a wheel step) scrolls the page by, 0 if it doesn't scroll it
+// the mouse event is taken into event (its bstate is 0 if there's none)
+static int scroll_lines(int ch, MEVENT *event) {
+  event->bstate = 0;
+  switch(ch) {
+    case KEY_DOWN:
+    case KEY_UP:
+      if(current_mode != SCROLL_MODE)
+        return 0;
+      return (ch == KEY_DOWN ? 1 : -1) * (is_offline ? 1 : scrolling_velocity);
+    case KEY_MOUSE:
+      // "For example, in xterm, wheel/scrolling mice send
+      // position reports as a sequence of presses of buttons  4  or  5  without
+      // matching button-releases."
+      // https://invisible-island.net/ncurses/man/curs_mouse.3x.html#h3-Mouse-events
+      if(getmouse(event) != OK) {
+        event->bstate = 0;
+        return 0;
+      }
+      if(event->bstate & BUTTON5_PRESSED)
+        return wheel_lines();
+      if(event->bstate & BUTTON4_PRESSED)
+        return -wheel_lines();
+      return 0;
+    default:
+      return 0;
+  }
+}
+
+// a held key or a spun wheel queues more steps than the terminal can show, 
+// so everything that's already there is taken and the page is scrolled by all of it at once,
+// the first thing that isn't scrolling is left for the next round
+static int drain_scroll(int lines) {
+  int ch;
+  MEVENT event;
+  timeout(0);
+  while((ch = getch()) != ERR) {
+    int more = scroll_lines(ch, &event);
+    if(more == 0) {
+      // the mouse event was taken already, so it goes back with its KEY_MOUSE (e.g. a click after the wheel)
+      if(ch != KEY_MOUSE)
+        ungetch(ch);
+      else if(event.bstate)
+        ungetmouse(&event);
+      break;
+    }
+    lines += more;
+  }
+  timeout(-1);
+  return lines;
+}
+
+// like that many scrolldowns (or scrollups), but printed once
+static void scroll_by(struct page_t *page, WINDOW *win, int lines, int page_y) {
+  if(!page_has_lines(page) || lines == 0)
+    return;
+
+  int first_line_index = page->first_line_index + lines;
+  if(lines > 0) {
+    int lines_num = layout_ensure_lines(page, first_line_index + page_y);
+    if(first_line_index > lines_num - page_y)
+      first_line_index = lines_num - page_y;
+    if(first_line_index < page->first_line_index)
+      first_line_index = page->first_line_index;
+  }
+  else if(first_line_index < 0) {
+    first_line_index = 0;
+  }
+
+  if(first_line_index != page->first_line_index)
+    scroll_page_to(page, win, first_line_index, page_y, NULL);
+}
+
+// the links (or headings) after the measured part aren't known yet, so it's measured until 
+// there's the k-th one or the page ends (while the worker runs, there's only what it has done)
+static bool find_indexed(struct page_t *page, int k, int page_y, int (*indexed_num)(const struct page_t*)) {
+  while(k >= indexed_num(page) && !layout_is_done(page)) {
+    int lines_num = page->lines_num;
+    if(layout_ensure_lines(page, lines_num + page_y) == lines_num)
+      break;
+  }
+  return k < indexed_num(page);
+}
+
+// a line in the next or previous screen is shown by paging, 
+// one that's further away is shown at the top of the screen
+static void show_line(
     struct page_t *page, 
     WINDOW *win, 
+    int index,
     int page_y,
     println_func_def print_func
     ) {
-  bool is_pagedown = false;
-start:
-  if(page->last_line_index > page->lines_num)
+  if(index >= page->first_line_index && index < page->last_line_index) {
+    reprint_line(page, win, index, index - page->first_line_index, print_func);
     return;
-  if(page->lines == NULL)
-    return;
-
-  int link_index = page->selected_link_index;
-  if(link_index == -1) { 
-    link_index = page->first_line_index - 1;
-  }
-  else if(link_index < page->first_line_index || link_index >= page->last_line_index){
-    page->lines[link_index]->attr ^= A_STANDOUT; 
-    link_index = page->first_line_index - 1;
-    page->selected_link_index = -1;
   }
 
-  int offset = link_index - page->first_line_index;
-    
-  // if the next link is on the current page, then just highlight it 
-  for(int i = 1; i < page->last_line_index - link_index; i++) {
-    if(page->lines[link_index + i]->link != NULL) {
-      // unhighlight the old selected link
-      if(page->selected_link_index != -1) {
-        page->lines[link_index]->attr ^= A_STANDOUT;
-        reprint_line(page, win, link_index, offset, print_func);
-      }
-      // highlight the selected link
-      page->lines[link_index + i]->attr ^= A_STANDOUT;
-      page->selected_link_index = link_index + i;
-      reprint_line(page, win, link_index + i, offset + i, print_func);
-      return;
-    }
+  int start_line = index;
+  if(index >= page->last_line_index && index < page->last_line_index + page_y)
+    start_line = page->last_line_index;
+  else if(index < page->first_line_index && index >= page->first_line_index - page_y)
+    start_line = page->first_line_index - page_y;
+
+  layout_ensure_lines(page, start_line + page_y);
+  if(start_line > page->lines_num - page_y)
+    start_line = page->lines_num - page_y;
+  if(start_line < 0)
+    start_line = 0;
+
+  scroll_page_to(page, win, start_line, page_y, print_func);
+}
+
+static void select_link(
+    struct page_t *page, 
+    WINDOW *win, 
+    int link,
+    int page_y,
+    println_func_def print_func
+    ) {
+  int old_index = page->selected_link_index;
+  if(old_index != -1) {
+    page_line(page, old_index)->attr &= ~A_STANDOUT;
+    // the pad may have it even if it's not on the screen
+    if(is_padded(win) || (old_index >= page->first_line_index && old_index < page->last_line_index))
+      reprint_line(page, win, old_index, old_index - page->first_line_index, print_func);
   }
 
-  // if there's no link on the page, then go page down and find a link in a new page
-  if(is_pagedown) return;
-  is_pagedown = true;
-  pagedown(page, win, page_y, print_func);
-  goto start;
+  int index = layout_link_line(page, link);
+  page_line(page, index)->attr |= A_STANDOUT;
+  page->selected_link_index = index;
+  show_line(page, win, index, page_y, print_func);
 }
 
+static void nextlink(
+    struct page_t *page, 
+    WINDOW *win, 
+    int page_y,
+    println_func_def print_func
+    ) {
+  if(!page_has_lines(page))
+    return;
+
+  // a selected link that's scrolled away doesn't count, it goes from the screen then
+  int index = page->first_line_index;
+  int selected = page->selected_link_index;
+  if(selected >= page->first_line_index && selected < page->last_line_index)
+    index = selected + 1;
+
+  int link = layout_link_from(page, index);
+  if(find_indexed(page, link, page_y, layout_links_num))
+    select_link(page, win, link, page_y, print_func);
+}
 
 static void prevlink(
     struct page_t *page, 
@@ -1005,49 +1002,132 @@ static void prevlink(
     int page_y,
     println_func_def print_func
     ) {
-  bool is_pageup = false;
-
-start:
-  if(page->lines == NULL)
-    return;
-  if(page->first_line_index < 0)
+  if(!page_has_lines(page))
     return;
 
-  int link_index = page->selected_link_index;
-  if(link_index == -1) {
-    link_index = page->last_line_index;
+  int index = page->last_line_index;
+  int selected = page->selected_link_index;
+  if(selected >= page->first_line_index && selected < page->last_line_index)
+    index = selected;
+
+  // the last one before index
+  int link = layout_link_from(page, index) - 1;
+  if(link >= 0)
+    select_link(page, win, link, page_y, print_func);
+}
+
+// links are numbered from 1 for the user
+static bool jump_to_link(
+    struct page_t *page, 
+    WINDOW *win, 
+    int number,
+    int page_y,
+    println_func_def print_func
+    ) {
+  if(!page_has_lines(page) || number < 1 || !find_indexed(page, number - 1, page_y, layout_links_num))
+    return false;
+  select_link(page, win, number - 1, page_y, print_func);
+  return true;
+}
+
+// the screen goes to the line with the match, false if the worker hasn't laid it out yet
+static bool show_match(struct page_t *page, struct response *resp, const char *match) {
+  int lines_num;
+  int index = layout_offset_line(page, match - resp->body, &lines_num);
+  if(index == -1)
+    return false;
+
+  // it's the k-th match of its paragraph, so it's on the line with the k-th shown one
+  // (or the first line, if the text of the paragraph isn't shown as it is, e.g. a link)
+  const char *start = resp->body + layout_line_offset(page, index), *p = start;
+  int k = 0;
+  while((p = search_find(&page_search, p, match - p)) != NULL) {
+    k++;
+    p++;
   }
-  else if(link_index < page->first_line_index || link_index >= page->last_line_index){
-    page->lines[link_index]->attr ^= A_STANDOUT;
-    link_index = page->last_line_index;
-    page->selected_link_index = -1;
+  for(int i = 0; i < lines_num; i++) {
+    const char *text = page_line(page, index + i)->text;
+    const char *end = text + strlen(text);
+    for(p = text; (p = search_find(&page_search, p, end - p)) != NULL; p += page_search.len)
+      if(k-- == 0)
+        break;
+    if(p != NULL) {
+      index += i;
+      break;
+    }
   }
 
-  int offset = link_index - page->first_line_index;
-  // if the next link is on the current page, then just highlight it 
-  for(int i = 1; i <= link_index - page->first_line_index; i++) {
-    if(link_index - i < 0)
-      return;
-    
-    if(page->lines[link_index - i]->link != NULL) {      
-      // unhighlight the old selected link
-      if(page->selected_link_index != -1) {
-        page->lines[link_index]->attr ^= A_STANDOUT;
-        reprint_line(page, win, link_index, offset, print_func);
-      }
-      // highlight the selected link
-      page->lines[link_index - i]->attr ^= A_STANDOUT;
-      page->selected_link_index = link_index - i;
-      reprint_line(page, win, link_index - i, offset - i, print_func);
-      return;
+  // every line on the screen may have a match, so it's all printed again
+  if(index >= page->first_line_index && index < page->last_line_index) {
+    werase(main_win);
+    print_page(page, main_win, page->first_line_index, main_win_y, NULL);
+  }
+  else {
+    show_line(page, main_win, index, main_win_y, NULL);
+  }
+  return true;
+}
+
+// the next match from `from`, or the previous one before it, 
+// it goes around the page if there's none
+static void find_match(struct page_t *page, struct response *resp, const char *from, bool is_backward) {
+  const char *body = resp->body, *end = resp->body + resp->body_size;
+  const char *match;
+  bool is_wrapped = false;
+
+  if(!is_backward) {
+    match = search_find(&page_search, from, end - from);
+    if(match == NULL) {
+      match = search_find(&page_search, body, end - body);
+      is_wrapped = true;
     }
   }
-  
-  // if there's no link on the page, then go page up and find a link in a new page
-  if(is_pageup) return;
-  is_pageup = true;
-  pageup(page, win, page_y, print_func);
-  goto start;
+  else {
+    size_t before = from - body + page_search.len - 1;
+    match = search_find_last(&page_search, body, before < resp->body_size ? before : resp->body_size);
+    if(match == NULL) {
+      match = search_find_last(&page_search, body, end - body);
+      is_wrapped = true;
+    }
+  }
+
+  if(match == NULL) {
+    search_match = NULL;
+    werase(main_win);
+    print_page(page, main_win, page->first_line_index, main_win_y, NULL);
+    info_bar_print("Pattern not found: %s", page_search.pattern);
+    return;
+  }
+
+  search_match = match;
+  if(!show_match(page, resp, match))
+    info_bar_print("The match isn't laid out yet");
+  else if(is_wrapped)
+    info_bar_print("Search hit the %s, continuing at the %s", is_backward ? "top" : "bottom", is_backward ? "bottom" : "top");
+  else
+    info_bar_clear();
+}
+
+// the number of every link on the screen, over the start of its first line
+static void draw_link_hints(struct page_t *page, WINDOW *win) {
+  if(!page_has_lines(page))
+    return;
+
+  int first_row_index = page->first_line_index;
+  if(is_padded(win)) {
+    win = page_pad.win;
+    first_row_index = page_pad.first;
+  }
+
+  int links_num = layout_links_num(page);
+  for(int link = layout_link_from(page, page->first_line_index); link < links_num; link++) {
+    int index = layout_link_line(page, link);
+    if(index >= page->last_line_index)
+      break;
+    wattron(win, A_REVERSE | A_BOLD);
+    mvwprintw(win, index - first_row_index, 0, "%d", link + 1);
+    wattroff(win, A_REVERSE | A_BOLD);
+  }
 }
 
 
@@ -1076,21 +1156,20 @@ static void show_dialog(enum dialog_types dialog_type) {
     case OFFLINE:
       mvwprintw(dialog_title_win, 0, dialog_subwin_x / 2 - 3, "%s", "Offline");
       break;
+    case OUTLINE:
+      mvwprintw(dialog_title_win, 0, dialog_subwin_x / 2 - 3, "%s", "Outline");
+      break;
   }
   
-  refresh_windows();
-  show_panel(dialog_panel);
   is_dialog_hidden = false;
 }
 
 static void hide_dialog() {
-  refresh_windows();
-  hide_panel(dialog_panel);
-  update_panels();
-  doupdate();
+  // the page under it is copied again
   touchwin(main_win);
   is_dialog_hidden = true;
   current_focus = MAIN_WINDOW;
+  refresh_windows();
 }
 
 static void print_to_dialog(const char *format, ...) {
@@ -1109,8 +1188,7 @@ static void print_to_dialog(const char *format, ...) {
   va_end(args);
 
   wprintw(dialog_subwin, "%s", dialog_message);
-  update_panels();
-  doupdate();
+  refresh_windows();
 }
 
 static char dialog_ask(struct page_t *page, struct response *resp, const char *options) {
@@ -1131,6 +1209,72 @@ loop:
   goto loop;
 }
 
+// ########## OUTLINE ##########
+
+// the heading goes to the top of the screen (unless it's on the last one)
+static void show_heading(struct page_t *page, WINDOW *win, int heading, int page_y) {
+  int start_line = layout_heading_line(page, heading);
+  layout_ensure_lines(page, start_line + page_y);
+  if(start_line > page->lines_num - page_y)
+    start_line = page->lines_num - page_y;
+  if(start_line < 0)
+    start_line = 0;
+
+  scroll_page_to(page, win, start_line, page_y, NULL);
+}
+
+static void next_heading(struct page_t *page, WINDOW *win, int page_y) {
+  if(!page_has_lines(page))
+    return;
+  int heading = layout_heading_from(page, page->first_line_index + 1);
+  if(find_indexed(page, heading, page_y, layout_headings_num))
+    show_heading(page, win, heading, page_y);
+}
+
+static void prev_heading(struct page_t *page, WINDOW *win, int page_y) {
+  if(!page_has_lines(page))
+    return;
+  int heading = layout_heading_from(page, page->first_line_index) - 1;
+  if(heading >= 0)
+    show_heading(page, win, heading, page_y);
+}
+
+// the headings are indented by their level, the one the screen is in is selected
+static void show_outline(struct page_t *page) {
+  if(!page_has_lines(page))
+    return;
+  // all of them, unless the worker is still on it
+  layout_ensure_lines(page, INT_MAX);
+  int headings_num = layout_headings_num(page);
+  if(headings_num == 0) {
+    info_bar_print("There are no headings on the page");
+    return;
+  }
+
+  // layout_links copies them, so they only live until it's done
+  struct arena tmp = {0};
+  char **entries = arena_alloc(&tmp, headings_num * sizeof(char*));
+  for(int i = 0; i < headings_num; i++) {
+    struct layout_heading h;
+    layout_heading(page, i, &h);
+    int indent = 2 * (h.level - 1);
+    entries[i] = arena_alloc(&tmp, indent + h.len + 1);
+    memset(entries[i], ' ', indent);
+    memcpy(entries[i] + indent, h.text, h.len);
+    entries[i][indent + h.len] = '\0';
+  }
+  layout_links(&outline, entries, headings_num, dialog_subwin_x - offset_x);
+  arena_free(&tmp);
+
+  show_dialog(OUTLINE);
+  int current = layout_heading_from(page, page->first_line_index + 1) - 1;
+  print_page(&outline, dialog_subwin, 0, dialog_subwin_y, NULL);
+  select_link(&outline, dialog_subwin, current < 0 ? 0 : current, dialog_subwin_y, NULL);
+  draw_scrollbar(dialog_subwin, &outline, dialog_subwin_y, dialog_win_x - 2 - offset_x);
+  refresh_windows();
+  current_focus = OUTLINE_DIALOG;
+}
+
 // ########## LINK HANDLE ##########
 static char* handle_link_click(char *base_url, char *link, struct page_t *page, struct response *resp) {
   char *new_url = strdup(base_url);
@@ -1138,7 +1282,8 @@ static char* handle_link_click(char *base_url, char *link, struct page_t *page,
   if(!link)
     goto nullret;
 
-  if(get_protocol(link) == GEMINI) {
+  // an absolute url of a protocol we can fetch by ourselves
+  if(get_protocol(link) != null && fetch_get_backend(link) != NULL) {
       if(link[0] == '/')
         link += 2;
 
@@ -1164,8 +1309,8 @@ static char* handle_link_click(char *base_url, char *link, struct page_t *page,
     int url_length = strlen(new_url);
     char *p = new_url;
 
-    // cut the gemini scheme from the base url
-    if(m_strncmp(new_url, "gemini://") == 0) p += 9;
+    // cut the scheme from the base url
+    p = skip_url_scheme(new_url);
     // if link has no directory then add it
     if(strchr(p, '/') == NULL) {
       url_length += 1;
@@ -1173,8 +1318,7 @@ static char* handle_link_click(char *base_url, char *link, struct page_t *page,
       new_url[url_length - 1] = '/';
       new_url[url_length]     = '\0';
       
-      p = new_url;
-      if(m_strncmp(new_url, "gemini://") == 0) p += 9;
+      p = skip_url_scheme(new_url);
     }
 
     // if there's an absolute path
@@ -1248,7 +1392,8 @@ nullret:
 
 
 // ########## OFFLINE ##########
-static char** load_dirs(char *relative_path, int *n_dirs_arg) {  
+// the names are in the arena, so they all go with it
+static char** load_dirs(struct arena *arena, char *relative_path, int *n_dirs_arg) {  
   DIR *dp;
   struct dirent *ep;
   
@@ -1268,23 +1413,25 @@ static char** load_dirs(char *relative_path, int *n_dirs_arg) {
   char **dirs = NULL;
   int n_dirs = 0;
   if(dp != NULL) {
+    // counted first, the array can't grow in the arena
+    int max_dirs = 0;
+    while(readdir(dp) != NULL)
+      max_dirs++;
+    rewinddir(dp);
+    dirs = arena_alloc(arena, (max_dirs + 1) * sizeof(char*));
 //    fprintf(stderr,"%s", offline_path);
-    while((ep = readdir(dp)) != NULL) {
+    while((ep = readdir(dp)) != NULL && n_dirs < max_dirs) {
 //      if(relative_path[0] != 0);
 //      else if(strcmp(ep->d_name, ".") == 0) continue
       // TODO
       if(strcmp(ep->d_name, ".") == 0)
-        continue;
-      n_dirs++;
-      dirs = realloc(dirs, n_dirs * sizeof(char*));
-      if(ep->d_type == DT_DIR) {
-        dirs[n_dirs - 1] = malloc(strlen(ep->d_name) + 2);
-        strcpy(dirs[n_dirs - 1], ep->d_name); 
-        strcat(dirs[n_dirs - 1], "/");
-      } else {
-        dirs[n_dirs - 1] = strdup(ep->d_name);
-      }
-    
+        continue;
+      size_t len = strlen(ep->d_name);
+      char *name = arena_alloc(arena, len + 2);
+      memcpy(name, ep->d_name, len + 1);
+      if(ep->d_type == DT_DIR)
+        strcat(name, "/");
+      dirs[n_dirs++] = name;
     }
 
     (void) closedir(dp);
@@ -1298,6 +1445,14 @@ static char** load_dirs(char *relative_path, int *n_dirs_arg) {
 }
 
 // ########## REQUEST ##########
+static int ask_trust_mismatch(struct page_t *page, struct response *resp) {
+  show_dialog(INFO);
+  print_to_dialog("Fingerprint mistmatch! Do you want to trust it anyway? [y/n]");    
+  int selected_opt = dialog_ask(page, resp, yes_no_options);
+  hide_dialog();
+  return selected_opt != 'n';
+}
+
 static int request_gem_page(char *gemini_url, struct gemini_tls *gem_tls, struct page_t *page, struct response **resp) {
   
   bool was_redirected = false;
@@ -1305,51 +1460,60 @@ func_start:
   
   if(!gemini_url)
     return 0;
- 
-  info_bar_print("Connecting..."); 
-  refresh_windows();          
 
   struct response *new_resp = calloc(1, sizeof(struct response));
   if(new_resp == NULL)
     MALLOC_ERROR;
+
+  // a cached page is shown right away, a reload always goes to the server
+  bool is_reload = page->url && strcmp(page->url, gemini_url) == 0;
+  bool is_stale = false;
+  char cache_hash[CACHE_HASH_LEN + 1];
+  if(!is_reload && cache_lookup(gemini_url, new_resp, &is_stale, cache_hash))
+    goto got_response;
+ 
+  info_bar_print("Connecting..."); 
+  refresh_windows();          
   
   char fingerprint[100];  
   *fingerprint = '\0';
 
-  int conn_ret = tls_connect(gem_tls, gemini_url, new_resp, fingerprint);
+  struct fetch_conn *conn = fetch_conn_new(gem_tls, gemini_url);
+  if(conn == NULL) {
+    info_bar_print("Unsupported protocol!");
+    goto err;
+  }
+
+  int conn_ret = fetch_connect(conn, gemini_url, new_resp, fingerprint);
   if(conn_ret == 0) {
-    tls_reset(gem_tls);
+    fetch_conn_free(conn);
     info_bar_print(new_resp->error_message);
     goto err;
   }
 
   if(new_resp->cert_result == TOFU_FINGERPRINT_MISMATCH) {
-    show_dialog(INFO);
-    print_to_dialog("Fingerprint mistmatch! Do you want to trust it anyway? [y/n]");    
-    int selected_opt = dialog_ask(page, *resp, yes_no_options);
-    hide_dialog();
-
-    if(selected_opt == 'n') {
-      tls_reset(gem_tls);
+    if(!ask_trust_mismatch(page, *resp)) {
+      fetch_conn_free(conn);
       // info_bar_print("Didn't established connection, because of mistmatched fingerprint.");
       info_bar_print("Fingerprint mistmatch!");
       goto err;
     }
     else {
       assert(*fingerprint);
-      tofu_change_cert(gem_tls_get_known_hosts(gem_tls), gem_tls_get_cur_hostname(gem_tls), fingerprint);
+      fetch_trust_cert(conn, fingerprint);
       new_resp->cert_result = TOFU_OK;
     }
   }
 
-  tls_read(gem_tls, new_resp);
-  tls_reset(gem_tls);
+  fetch_read(conn, new_resp);
+  fetch_conn_free(conn);
 
   if(new_resp->error_message != NULL) {
     info_bar_print(new_resp->error_message);
     goto err;
   }
 
+got_response:
   check_response(new_resp);
   if(new_resp->error_message != NULL) {
     info_bar_print(new_resp->error_message);
@@ -1361,7 +1525,7 @@ func_start:
 
   switch(new_resp->status_code) {
     case CODE_SENSITIVE_INPUT:
-      field_opts_off(search_field[1], O_PUBLIC);
+      lineedit_set_hidden(&url_bar, true);
       // fall through
     case CODE_INPUT: 
       show_dialog(INFO);
@@ -1369,41 +1533,27 @@ func_start:
       print_to_dialog("%s", new_resp->meta); 
 
       curs_set(1);
-      refresh();
-      set_field_buffer(search_field[0], 0, "input:");
-      form_driver(search_form, REQ_CLR_FIELD);
+      lineedit_set_label(&url_bar, "input:");
+      lineedit_set(&url_bar, "");
       // to test gemini://geminispace.info/
       info_bar_print("Input required!");
       int c;
 input_loop:
-      wrefresh(search_bar_win);
+      refresh_windows();
       c = getch();
       switch(c) {
         case KEY_DOWN:
         case KEY_UP:
           hide_dialog();
           curs_set(0);
-          set_field_buffer(search_field[0], 0, "url:");
-          set_field_buffer(search_field[1], 0, page->url);
+          lineedit_set_label(&url_bar, "url:");
+          lineedit_set(&url_bar, page->url);
           info_bar_clear();
           goto err;
 
-        case KEY_LEFT:
-          form_driver(search_form, REQ_PREV_CHAR); goto input_loop;
-        case KEY_RIGHT:
-          form_driver(search_form, REQ_NEXT_CHAR); goto input_loop;
-        case KEY_BACKSPACE: case 127:
-          form_driver(search_form, REQ_DEL_PREV);  goto input_loop;
-        case KEY_DC:
-          form_driver(search_form, REQ_DEL_CHAR);  goto input_loop;
-        case 'W' - 64:
-          form_driver(search_form, REQ_DEL_LINE);  goto input_loop;
         case 10:
-        case KEY_ENTER:
-          form_driver(search_form, REQ_VALIDATION);
-          char *query = strdup(trim_whitespaces(field_buffer(search_field[1], 0)));
-          wmove(main_win, 0, 0);
-          form_driver(search_form, REQ_PREV_FIELD);
+        case KEY_ENTER:;
+          char *query = lineedit_strdup(&url_bar);
          
           int res = get_valid_query(&query);
           if(!res) {
@@ -1426,11 +1576,14 @@ input_loop:
           gemini_url = new_link;
           was_redirected = true;
           
-          free_resp(new_resp);
+          response_free(new_resp);
           free(query);
           hide_dialog();
           curs_set(0);
-          set_field_buffer(search_field[0], 0, "url:");
+          lineedit_set_label(&url_bar, "url:");
+          // a sensitive input isn't left in it
+          lineedit_set(&url_bar, "");
+          lineedit_set_hidden(&url_bar, false);
           goto func_start;
 
         case KEY_RESIZE:
@@ -1438,12 +1591,12 @@ input_loop:
           goto input_loop;
 
         default:
-          form_driver(search_form, c); 
+          lineedit_key(&url_bar, c); 
           goto input_loop;
       }
    
-      // if it was sensitive input, then set the public input again
-      field_opts_on(search_field[1], O_PUBLIC);
+      // if it was sensitive input, then show the input again
+      lineedit_set_hidden(&url_bar, false);
       break;
     
     case 20 ... 29:;
@@ -1574,7 +1727,7 @@ go_save_it:;
 loop:;
       int ch = getch();
       if(ch == 'y' || ch == 'Y') {
-        free_resp(new_resp);
+        response_free(new_resp);
         gemini_url = new_link;
         was_redirected = true;
 
@@ -1585,8 +1738,7 @@ loop:;
         if(new_link)
           free(new_link);
         // update search bar
-        form_driver(search_form, REQ_CLR_FIELD);
-        set_field_buffer(search_field[1], 0, page->url);
+        lineedit_set(&url_bar, page->url);
         
         info_bar_print("Didn't redirected"); 
         hide_dialog();
@@ -1647,6 +1799,10 @@ loop:;
   }
 
 
+  // the shown page stays in the history, unless it's the same one again
+  if(!is_reload)
+    history_push(page, resp);
+
   if(page->url && page->url != gemini_url) {
     free(page->url);
     page->url = NULL;
@@ -1658,39 +1814,33 @@ loop:;
     page->url = strdup(gemini_url);
 
 
+  // the layout's worker reads the old body, so it goes first
+  layout_free(page);
+
+  // the old document points into the old body
+  gemtext_free(&page->doc);
   if(*resp != NULL)
-    free_resp(*resp);
-  
-  if(page->lines)
-    free_lines(page);
+    response_free(*resp);
   
   *resp = new_resp;
 
-  int paragraphs_num = 0;
-  char **paragraphs = string_to_paragraphs((*resp)->body, &paragraphs_num);
-
-  page->lines = paragraphs_to_lines(
-      page, 
-      paragraphs, 
-      paragraphs_num, 
-      main_win_x, 
-      false
-  );
-
-  free_paragraphs(paragraphs, paragraphs_num);
+  // only the lines are counted here, the rest is parsed as it's shown,
+  // a big page from the cache may have been parsed before
+  if(!(*resp)->mapped_size || !cache_load_doc(&page->doc, *resp, cache_hash))
+    gemtext_parse_init(&page->doc, (*resp)->body, (*resp)->body_size);
+  layout_gemtext(page, main_win_x - offset_x);
+  search_match = NULL;
 
   // print the response
   werase(main_win);
   print_page(page, main_win, 0, main_win_y, NULL);
   
   // update search bar
-  form_driver(search_form, REQ_CLR_FIELD);
-  set_field_buffer(search_field[1], 0, page->url);
+  lineedit_set(&url_bar, page->url);
 
   // bookmarking
   page->is_bookmarked = false;
-  char *g_p = page->url;
-  if(m_strncmp(g_p, "gemini://") == 0) g_p += 9;
+  char *g_p = skip_url_scheme(page->url);
 
   if(!strchr(g_p, '/')) {
     int len = strlen(page->url);
@@ -1698,15 +1848,25 @@ loop:;
     page->url[len] = '/';
     page->url[len + 1] = '\0';
     
-    g_p = page->url;
-    if(m_strncmp(g_p, "gemini://") == 0) g_p += 9;
+    g_p = skip_url_scheme(page->url);
   }
 
   if(bookmarks_links && is_bookmark_saved(bookmarks_links, num_bookmarks_links, g_p) != -1)
       page->is_bookmarked = true;
   
   print_is_bookmarked(page->is_bookmarked);
-  refresh();
+  refresh_windows();
+
+  if((*resp)->mapped_size) {
+    if(is_stale) {
+      cache_revalidate(gem_tls, page->url);
+      info_bar_print("From the cache, looking for a newer version...");
+    }
+    else
+      info_bar_print("From the cache");
+    return 1;
+  }
+  cache_store(page->url, *resp);
 
   switch((*resp)->cert_result) {
     case TOFU_OK:
@@ -1722,6 +1882,9 @@ loop:;
       else 
         info_bar_print("New hostname!");
       break;
+    case TOFU_NO_TLS:
+      info_bar_print("Plain-text connection (no TLS)");
+      break;
     default:
       assert(0);
   }
@@ -1741,14 +1904,335 @@ err:
   if(was_redirected)
     free(gemini_url);
 
-  field_opts_on(search_field[1], O_PUBLIC);
-  free_resp(new_resp);
+  lineedit_set_hidden(&url_bar, false);
+  response_free(new_resp);
   return 0;
 }
 
+// back (dir < 0) or forward, a kept page is only swapped with the shown one and drawn,
+// one that isn't kept anymore is fetched again
+static void go_history(int dir, struct gemini_tls *gem_tls, struct page_t *page, struct response **resp) {
+  struct history_list_t *entry = history_peek(dir);
+  if(entry == NULL) {
+    info_bar_print(dir < 0 ? "Nothing back!" : "Nothing forward!");
+    return;
+  }
+
+  if(entry->page == NULL) {
+    char *url = strdup(entry->url);
+    if(url == NULL)
+      MALLOC_ERROR;
+    history_set_target(entry);
+    request_gem_page(url, gem_tls, page, resp);
+    // it may not have got there
+    history_set_target(NULL);
+    free(url);
+    return;
+  }
+
+  history_swap(entry, page, resp);
+  // it was laid out for the width the screen had then
+  layout_resize(page, main_win_x - offset_x);
+  search_match = NULL;
+
+  werase(main_win);
+  print_page(page, main_win, page->first_line_index, main_win_y, NULL);
+  lineedit_set(&url_bar, page->url);
+
+  // it could have been bookmarked since
+  page->is_bookmarked = bookmarks_links && 
+    is_bookmark_saved(bookmarks_links, num_bookmarks_links, skip_url_scheme(page->url)) != -1;
+  print_is_bookmarked(page->is_bookmarked);
+  info_bar_clear();
+}
+
+// a stale page from the cache was fetched again, if it changed and it's still shown,
+// the new version takes its place (on the same line)
+static void poll_revalidation(struct page_t *page, struct response **resp) {
+  char *url = NULL;
+  struct response *new_resp = cache_poll_revalidated(&url);
+  if(url == NULL)
+    return;
+
+  // the cache has the '/' after a bare host too, like page->url
+  if(is_offline || page->url == NULL || strcmp(url, page->url) != 0) {
+    response_free(new_resp);
+    free(url);
+    return;
+  }
+  free(url);
+  // it's the same (or it couldn't be fetched)
+  if(new_resp == NULL) {
+    info_bar_print("From the cache");
+    return;
+  }
+
+  int first_line_index = page->first_line_index;
+  // the layout's worker reads the old body, so it goes first
+  layout_free(page);
+  gemtext_free(&page->doc);
+  response_free(*resp);
+  *resp = new_resp;
+
+  gemtext_parse_init(&page->doc, (*resp)->body, (*resp)->body_size);
+  layout_gemtext(page, main_win_x - offset_x);
+  search_match = NULL;
+  if(layout_ensure_lines(page, first_line_index + main_win_y) < first_line_index + main_win_y)
+    first_line_index = page->lines_num > main_win_y ? page->lines_num - main_win_y : 0;
+
+  werase(main_win);
+  print_page(page, main_win, first_line_index, main_win_y, NULL);
+  info_bar_print("Updated to a newer version");
+}
+
+// ########## UPLOAD ##########
+// asks for a line in the search bar, returns NULL if the user went back
+static char *prompt_search_bar(const char *label, const char *initial, struct page_t *page, struct response *resp) {
+  char *line = NULL;
+
+  curs_set(1);
+  lineedit_set_label(&url_bar, label);
+  lineedit_set(&url_bar, initial ? initial : "");
+  lineedit_end(&url_bar);
+
+  while(1) {
+    refresh_windows();
+    int c = getch();
+    switch(c) {
+      case KEY_DOWN:
+      case KEY_UP:
+        goto end;
+      case KEY_RESIZE:
+        resize_screen(page, resp);
+        break;
+      case 10:
+      case KEY_ENTER:
+        line = lineedit_strdup(&url_bar);
+        goto end;
+      default:
+        lineedit_key(&url_bar, c);
+        break;
+    }
+  }
+
+end:
+  curs_set(0);
+  lineedit_set_label(&url_bar, "url:");
+  lineedit_set(&url_bar, page->url ? page->url : "");
+  return line;
+}
+
+// the pattern is searched as it's typed, from the screen it started on, 
+// going back (up or down) leaves the screen there without the search
+static void find_in_page(struct page_t *page, struct response *resp) {
+  if(resp == NULL || !page_has_lines(page))
+    return;
+  int origin_line = page->first_line_index;
+  const char *origin = resp->body + layout_line_offset(page, origin_line);
+
+  curs_set(1);
+  lineedit_set_label(&url_bar, "find:");
+  lineedit_set(&url_bar, page_search.pattern ? page_search.pattern : "");
+  lineedit_end(&url_bar);
+
+  while(1) {
+    refresh_windows();
+    int c = getch();
+    switch(c) {
+      case KEY_DOWN:
+      case KEY_UP:
+        search_free(&page_search);
+        search_match = NULL;
+        info_bar_clear();
+        werase(main_win);
+        print_page(page, main_win, origin_line, main_win_y, NULL);
+        refresh_windows();
+        goto end;
+      case KEY_RESIZE:
+        resize_screen(page, resp);
+        continue;
+      case 10:
+      case KEY_ENTER:
+        goto end;
+      default:
+        lineedit_key(&url_bar, c);
+        break;
+    }
+
+    // the cursor only moved, or a character isn't whole yet
+    char *pattern = lineedit_strdup(&url_bar);
+    if(strcmp(pattern, page_search.pattern ? page_search.pattern : "") == 0) {
+      free(pattern);
+      continue;
+    }
+
+    search_set(&page_search, pattern);
+    free(pattern);
+    if(search_is_active(&page_search)) {
+      find_match(page, resp, origin, false);
+    }
+    else {
+      search_match = NULL;
+      info_bar_clear();
+      werase(main_win);
+      print_page(page, main_win, origin_line, main_win_y, NULL);
+    }
+    refresh_windows();
+  }
+
+end:
+  curs_set(0);
+  lineedit_set_label(&url_bar, "url:");
+  lineedit_set(&url_bar, page->url ? page->url : "");
+}
+
+static const char *guess_mime_type(const char *path) {
+  const char *ext = strrchr(path, '.');
+  if(ext == NULL || strchr(ext, '/'))
+    return "application/octet-stream";
+  if(strcmp(ext, ".gmi") == 0 || strcmp(ext, ".gemini") == 0)
+    return "text/gemini";
+  if(strcmp(ext, ".txt") == 0)
+    return "text/plain";
+  if(strcmp(ext, ".png") == 0)
+    return "image/png";
+  if(strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0)
+    return "image/jpeg";
+  return "application/octet-stream";
+}
+
+static void upload_progress(size_t sent, size_t total, void *arg) {
+  (void) arg;
+  info_bar_print(
+      "Uploading... %d%% (%.1f/%.1f MiB)", 
+      (int)(sent * 100 / total), 
+      sent / (1024.0 * 1024.0), 
+      total / (1024.0 * 1024.0)
+  );
+}
+
+// titan://, the file is streamed from the disk, so its size doesn't matter
+static int upload_titan_file(struct gemini_tls *gem_tls, struct page_t *page, struct response **resp) {
+  int return_val = 0, fd = -1;
+  char *titan_url = NULL, *path = NULL, *full_url = NULL, *new_link = NULL;
+  struct gemini_conn *conn = NULL;
+  struct response *new_resp = NULL;
+
+  // by default upload to the current page
+  char initial[1024] = "titan://";
+  if(page->url)
+    snprintf(initial, sizeof(initial), "titan://%s", skip_url_scheme(page->url));
+
+  if((titan_url = prompt_search_bar("titan:", initial, page, *resp)) == NULL || !*titan_url)
+    goto end;
+  if((path = prompt_search_bar("file:", NULL, page, *resp)) == NULL || !*path)
+    goto end;
+
+  fd = open(path, O_RDONLY);
+  struct stat st;
+  if(fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+    info_bar_print("Can't open %s", path);
+    goto end;
+  }
+
+  // the user may already have given the parameters (e.g. with ;token=)
+  size_t full_url_len = strlen(titan_url) + 128;
+  full_url = malloc(full_url_len);
+  if(full_url == NULL)
+    MALLOC_ERROR;
+  // the parameters go after the path, "titan://host;mime=..." would make them a part of the host
+  char *host = skip_url_scheme(titan_url);
+  int host_len = strcspn(host, "/;");
+  const char *slash = host[host_len] == '/' ? "" : "/";
+  int n = snprintf(full_url, full_url_len, "%.*s%s%s", (int)(host + host_len - titan_url), titan_url, slash, host + host_len);
+  if(strstr(titan_url, ";size=") == NULL)
+    snprintf(full_url + n, full_url_len - n, ";mime=%s;size=%lld", guess_mime_type(path), (long long)st.st_size);
+
+  info_bar_print("Connecting..."); 
+  refresh_windows();          
+
+  new_resp = calloc(1, sizeof(struct response));
+  if(new_resp == NULL)
+    MALLOC_ERROR;
+
+  char fingerprint[100];  
+  *fingerprint = '\0';
+
+  conn = tls_conn_new(gem_tls);
+  if(!tls_connect(conn, full_url, new_resp, fingerprint)) {
+    info_bar_print(new_resp->error_message);
+    goto end;
+  }
+
+  if(new_resp->cert_result == TOFU_FINGERPRINT_MISMATCH) {
+    if(!ask_trust_mismatch(page, *resp)) {
+      info_bar_print("Fingerprint mistmatch!");
+      goto end;
+    }
+    assert(*fingerprint);
+    tls_trust_cert(conn, fingerprint);
+  }
+
+  if(!tls_upload_file(conn, fd, st.st_size, &upload_progress, NULL, new_resp)) {
+    info_bar_print(new_resp->error_message);
+    goto end;
+  }
+
+  tls_read(conn, new_resp);
+  if(new_resp->error_message == NULL)
+    check_response(new_resp);
+  if(new_resp->error_message != NULL) {
+    info_bar_print(new_resp->error_message);
+    goto end;
+  }
+
+  switch(new_resp->status_code) {
+    // servers usually redirect to the uploaded resource
+    case CODE_REDIRECT_PERMANENT:
+    case CODE_REDIRECT_TEMPORARY:
+      assert(new_resp->meta);
+      new_link = handle_link_click(page->url, new_resp->meta, page, *resp);
+      tls_conn_free(conn);
+      conn = NULL;
+      if(new_link)
+        return_val = request_gem_page(new_link, gem_tls, page, resp);
+      if(return_val)
+        info_bar_print("Uploaded!");
+      break;
+    default:
+      if(new_resp->status_code / 10 == 2) {
+        return_val = 1;
+        info_bar_print("Uploaded!");
+        break;
+      }
+      info_bar_print("%d Upload failed!", new_resp->status_code);
+      if(new_resp->meta) {
+        show_dialog(INFO);
+        print_to_dialog("%s [press anything to continue]", new_resp->meta);    
+        dialog_ask(page, *resp, "");
+        hide_dialog();
+      }
+      break;
+  }
+
+end:
+  if(conn)
+    tls_conn_free(conn);
+  if(fd != -1)
+    close(fd);
+  if(new_resp)
+    response_free(new_resp);
+  free(new_link);
+  free(full_url);
+  free(path);
+  free(titan_url);
+  return return_val;
+}
+
 //static void load_offline_dirs(void) {
 //  int n_dirs = 0;
-//  char **dir_paragraphs = load_dirs(offline_path, &n_dirs);
+//  struct arena dirs_arena = {0};
+//  char **dir_paragraphs = load_dirs(&dirs_arena, offline_path, &n_dirs);
 //  offline_dirs.lines = paragraphs_to_lines(
 //    &offline_dirs,
 //    dir_paragraphs, 
@@ -1756,7 +2240,7 @@ err:
 //    main_win_x,
 //    true
 //  );
-//  free_paragraphs(dir_paragraphs, n_dirs);
+//  arena_free(&dirs_arena);
 //  offline.selected_link_index = -1;
 //}
 static inline void print_help(void) {
@@ -1766,17 +2250,28 @@ gemcurses <option>\n\
 Options:\n\
   -d,           debug (prints to debug.txt in data path)\n\
   -n,           don't use user certificates (some servers may not accept them)\n\
+  -p,           keep a few screens of the page in memory, so scrolling doesn't print them again\n\
+  -a,           the mouse wheel goes faster when it's spun fast\n\
 Usage:\n\
   KEY 	          ACTION\n\
   arrows up/down  go down or up on the page\n\
+  arrows l/r      go back or forward\n\
   / 	          search\n\
   q 	          change to link-mode/scroll-mode\n\
   enter           go to a link\n\
+  0-9             select the link with that number\n\
+  f               show/hide the numbers of links\n\
+  ctrl+f          find in the page (as it's typed)\n\
+  n/N             go to the next/previous match\n\
+  t               show the outline (headings) of the page\n\
+  ] / [           go to the next/previous heading\n\
   B 	          go to the defined main gemsite (antenna)\n\
   P 	          show bookmarks dialog\n\
+  R               refresh the gemsite\n\
   S 	          save the gemsite\n\
   C 	          show url of the selected link\n\
   A 	          bookmark current gemsite\n\
+  U 	          upload a file with titan\n\
   PgUp/PgDn 	  go page up or page down\n\
   mouse scroll    scroll\n\
   \n\
@@ -1788,10 +2283,12 @@ int main(int argc, char **argv) {
 
   uint32_t tls_init_flags = 0;
   int opt;
-  while ((opt = getopt(argc, argv, "dnh")) != -1) {
+  while ((opt = getopt(argc, argv, "dnpah")) != -1) {
     switch (opt) {
       case 'd': tls_init_flags |= TLS_DEBUGGING;    break;
       case 'n': tls_init_flags |= TLS_NO_USER_CERT; break;
+      case 'p': is_pad_used = true;                 break;
+      case 'a': is_wheel_accelerated = true;        break;
       case 'h':
       default:
         print_help();
@@ -1815,6 +2312,9 @@ int main(int argc, char **argv) {
     get_file_path_in_data_dir("log.txt", log_path, sizeof(log_path));
     freopen(log_path, "a", stderr);
   }
+  pool_init(0);
+  hoststats_load();
+  cache_load();
   // delete old debug.txt, the file includes only one gemcurses session (to do not clutter it fast)
   if((tls_init_flags & TLS_DEBUGGING) != 0){
     char debug_path[PATH_MAX + 1];
@@ -1824,7 +2324,7 @@ int main(int argc, char **argv) {
   }
 
   init_windows();
-  init_search_form(false);
+  init_url_bar();
   draw_borders();
   print_current_mode();
   print_is_bookmarked(false);
@@ -1840,12 +2340,11 @@ int main(int argc, char **argv) {
   
   bookmarks_links = load_bookmarks(&num_bookmarks_links);
   if(bookmarks_links != NULL) {
-    bookmarks.lines = paragraphs_to_lines(
+    layout_links(
         &bookmarks, 
         bookmarks_links, 
         num_bookmarks_links, 
-        dialog_subwin_x, 
-        true
+        dialog_subwin_x - offset_x
      );
   }
   // TODO
@@ -1860,37 +2359,47 @@ int main(int argc, char **argv) {
 
   int ch = 0;
   while(ch != KEY_F(1)) {
+    poll_revalidation(gem_page, &resp);
+    bool is_laying_out = poll_layout(gem_page, !is_offline);
+    // the whole page is parsed once it's laid out, so it can be kept parsed
+    if(!is_laying_out)
+      cache_store_doc(gem_page->url, resp, &gem_page->doc);
     if(!is_offline)
       draw_scrollbar(main_win, gem_page, main_win_y, max_x - offset_x);
     else
       draw_scrollbar(main_win, &offline, main_win_y, max_x - offset_x);
 
+    if(is_link_hints_shown && current_focus == MAIN_WINDOW)
+      draw_link_hints(is_offline ? &offline : gem_page, main_win);
+
     refresh_windows();
 
+    // wake up now and then to show how far the worker is, or if the page in the background came
+    timeout(is_laying_out || cache_is_revalidating() ? LAYOUT_POLL_MS : -1);
     ch = getch();
+    timeout(-1);
+    if(ch == ERR)
+      continue;
     // for fuzzing
 //    if (ch == -1)
 //      return 0;
 
     if(current_focus == MAIN_WINDOW){
+      if(ch < '0' || ch > '9')
+        typed_link_number = 0;
+
       switch(ch) {      
         case '/':
           if(!is_offline) {
             current_focus = SEARCH_FORM;
-            form_driver(search_form, REQ_PREV_FIELD);
-            form_driver(search_form, REQ_END_LINE);
+            lineedit_end(&url_bar);
             curs_set(1);
           }
           break;
         
         case KEY_DOWN:
-          if(current_mode == SCROLL_MODE) {
-            if(!is_offline)
-              for(int i = 0; i < scrolling_velocity; i++)
-                scrolldown(gem_page, main_win, main_win_y, NULL);
-            else
-              scrolldown(&offline, main_win, main_win_y, NULL);
-          }
+          if(current_mode == SCROLL_MODE)
+            scroll_by(is_offline ? &offline : gem_page, main_win, drain_scroll(scroll_lines(ch, &event)), main_win_y);
           else
             if(!is_offline)
               nextlink(gem_page, main_win, main_win_y, NULL);
@@ -1899,13 +2408,8 @@ int main(int argc, char **argv) {
           break;
         
         case KEY_UP:
-          if(current_mode == SCROLL_MODE) {
-            if(!is_offline)
-              for(int i = 0; i < scrolling_velocity; i++)
-                scrollup(gem_page, main_win, NULL);
-            else
-              scrollup(&offline, main_win, NULL);
-          }
+          if(current_mode == SCROLL_MODE)
+            scroll_by(is_offline ? &offline : gem_page, main_win, drain_scroll(scroll_lines(ch, &event)), main_win_y);
           else
             if(!is_offline)
               prevlink(gem_page, main_win, main_win_y, NULL);
@@ -1940,9 +2444,8 @@ int main(int argc, char **argv) {
               free(url);
               if(res) {
                 curs_set(0);
-                form_driver(search_form, REQ_CLR_FIELD);
-                set_field_buffer(search_field[1], 0, gem_page->url);
-                refresh();
+                lineedit_set(&url_bar, gem_page->url);
+                refresh_windows();
               } 
               info_bar_print("Refreshed!");
             }
@@ -1980,9 +2483,8 @@ int main(int argc, char **argv) {
             );
             if(res) {
               curs_set(0);
-              form_driver(search_form, REQ_CLR_FIELD);
-              set_field_buffer(search_field[1], 0, gem_page->url);
-              refresh();
+              lineedit_set(&url_bar, gem_page->url);
+              refresh_windows();
             }
           }
           break;
@@ -1990,17 +2492,17 @@ int main(int argc, char **argv) {
         // preview the link
         case 'C':;
           if(!is_offline) {
-            if(gem_page->lines && gem_page->selected_link_index != -1) {
+            if(page_has_lines(gem_page) && gem_page->selected_link_index != -1) {
               show_dialog(INFO);
-              print_to_dialog("%s", gem_page->lines[gem_page->selected_link_index]->link);
+              print_to_dialog("%s", page_line(gem_page, gem_page->selected_link_index)->link);
               dialog_ask(gem_page, resp, "");
               hide_dialog();
             }
           }
           else {
-            if(offline.lines && offline.selected_link_index != -1) {
+            if(page_has_lines(&offline) && offline.selected_link_index != -1) {
               show_dialog(INFO);
-              print_to_dialog("%s", offline.lines[offline.selected_link_index]->link);
+              print_to_dialog("%s", page_line(&offline, offline.selected_link_index)->link);
               dialog_ask(gem_page, resp, "");
               hide_dialog();
             }
@@ -2011,18 +2513,17 @@ int main(int argc, char **argv) {
         case 'P':;
           if(!is_offline) {
             if(num_bookmarks_links == 0) break;
-            if(bookmarks.lines == NULL) {
+            if(!page_has_lines(&bookmarks)) {
               if(bookmarks_links == NULL) {
                 info_bar_print("No bookmarks saved!");
                 break;
               }
 
-              bookmarks.lines = paragraphs_to_lines(
+              layout_links(
                   &bookmarks, 
                   bookmarks_links, 
                   num_bookmarks_links, 
-                  dialog_subwin_x, 
-                  true
+                  dialog_subwin_x - offset_x
                );
             }
             
@@ -2033,10 +2534,10 @@ int main(int argc, char **argv) {
           }
           else {
             show_dialog(OFFLINE);
-            if(offline_dirs.lines[0])
+            if(page_has_lines(&offline_dirs))
               print_page(&offline_dirs, dialog_subwin, 0, dialog_subwin_y, NULL);
             current_focus = BOOKMARKS_DIALOG;
-            wrefresh(dialog_win);
+            refresh_windows();
           }
           break;        
         
@@ -2058,71 +2559,6 @@ int main(int argc, char **argv) {
             gem_page->is_bookmarked = false;
             print_is_bookmarked(false);
           
-            // de-highlight the selected link
-            if(bookmarks.selected_link_index != -1) {
-              bookmarks.lines[bookmarks.selected_link_index]->attr ^= A_STANDOUT;
-              bookmarks.selected_link_index = -1;
-            }
-            // free link in bookmarks 
-            struct screen_line *line;
-            int first_index = -1, lines_to_delete_num = 0;
-            char *link_to_free = NULL;
-            for(int i = 0; i < bookmarks.lines_num; i++) {
-              line = bookmarks.lines[i];
-
-              if(strcmp(line->link, url) == 0) {
-                free(line->text);
-                // free the link only *once* because it's all the same in all lines
-                if(first_index == -1) {
-                  first_index = i;
-                  link_to_free = line->link;
-                }
-                lines_to_delete_num++;
-                free(line);
-              }
-            }
-            if(link_to_free)
-              free(link_to_free);
-
-            int last_index = first_index + lines_to_delete_num;
-            // if it's the last line then bookmarks.lines_num - last_line is 0, so no move
-            memmove(
-              &bookmarks.lines[first_index], 
-              &bookmarks.lines[last_index], 
-              sizeof(struct screen_line*) *(bookmarks.lines_num - last_index)
-            );
-            
-            bookmarks.lines_num -= lines_to_delete_num;
-            if (bookmarks.lines_num > 0)
-              bookmarks.lines = realloc(
-                  bookmarks.lines, 
-                  sizeof(struct screen_line*) * bookmarks.lines_num
-              );
-            else {
-              free(bookmarks.lines);
-              bookmarks.lines = NULL;
-            }
-         
-
-            // we deleted a bookmark at the end so the screen needs to go down a bit right
-            if(bookmarks.lines_num != 0 && bookmarks.last_line_index > bookmarks.lines_num - 1) {
-              /*
-              if(bookmarks.first_line_index > bookmarks.last_line_index - bookmarks.lines_num - 1)
-                bookmarks.first_line_index -= bookmarks.last_line_index - (bookmarks.lines_num - 1);
-              */
-              if(bookmarks.first_line_index - lines_to_delete_num >= 0)
-                bookmarks.first_line_index -= lines_to_delete_num;
-              else
-                bookmarks.first_line_index = 0;
-                
-              bookmarks.last_line_index = bookmarks.lines_num - 1;
-            }
-            
-            // i dont trust myself at all
-            assert(bookmarks.first_line_index >= 0);
-            assert(bookmarks.last_line_index >= 0);
-            assert(bookmarks.lines_num >= 0);
-
             delete_bookmark(url);
 
             // free link in bookmarks_links
@@ -2131,7 +2567,7 @@ int main(int argc, char **argv) {
                 memmove(
                   &bookmarks_links[bm_link_index], 
                   &bookmarks_links[bm_link_index + 1], 
-                  sizeof(struct screen_line*) *(num_bookmarks_links - bm_link_index - 1)
+                  sizeof(char*) *(num_bookmarks_links - bm_link_index - 1)
               );
             }
                
@@ -2143,44 +2579,19 @@ int main(int argc, char **argv) {
               free(bookmarks_links);
               bookmarks_links = NULL;
             }
-            break;
-          }
 
+            // the selected link may be the deleted one
+            relayout_bookmarks(false);
+          }
           else { 
             num_bookmarks_links++;
             bookmarks_links = realloc(bookmarks_links, sizeof(char*) * num_bookmarks_links);
             bookmarks_links[num_bookmarks_links - 1] = strdup(url);
             
             add_bookmark(url);
+            // it's added at the end, so the selected link stays where it was
+            relayout_bookmarks(true);
 
-            int prev_lines_num = bookmarks.lines_num;
-            int link_lines_num  = 0, new_lines_num   = 0;
-            int old_index = bookmarks.selected_link_index;
-            
-            struct screen_line **lines = paragraphs_to_lines(
-                &bookmarks, 
-                &url,
-                1, 
-                dialog_subwin_x, 
-                true
-            );
-
-            link_lines_num = bookmarks.lines_num;
-            new_lines_num = prev_lines_num + link_lines_num;
-            
-            if(prev_lines_num == 0) {
-              bookmarks.lines = lines;
-            }
-            else {
-              bookmarks.lines = realloc(bookmarks.lines, sizeof(char*) * new_lines_num);
-              for(int i = 0; i < link_lines_num; i++)
-                bookmarks.lines[prev_lines_num + i] = lines[i];
-            
-              free(lines);
-            }
-            
-            bookmarks.lines_num = new_lines_num;
-            bookmarks.selected_link_index = old_index;
             gem_page->is_bookmarked = true;
             print_is_bookmarked(true);
           }
@@ -2195,6 +2606,68 @@ int main(int argc, char **argv) {
     
           print_current_mode();
           break;
+
+        case 'F' - 64:
+          if(!is_offline)
+            find_in_page(gem_page, resp);
+          break;
+
+        case ']':
+          next_heading(is_offline ? &offline : gem_page, main_win, main_win_y);
+          break;
+        case '[':
+          prev_heading(is_offline ? &offline : gem_page, main_win, main_win_y);
+          break;
+        case 'T':
+        case 't':
+          show_outline(is_offline ? &offline : gem_page);
+          break;
+
+        case 'n':
+        case 'N':
+          if(is_offline || resp == NULL || !search_is_active(&page_search) || !page_has_lines(gem_page))
+            break;
+          if(search_match)
+            find_match(gem_page, resp, ch == 'n' ? search_match + 1 : search_match, ch == 'N');
+          else
+            find_match(gem_page, resp, resp->body + layout_line_offset(gem_page, gem_page->first_line_index), ch == 'N');
+          break;
+
+        case 'F':
+        case 'f':;
+          struct page_t *hinted_page = is_offline ? &offline : gem_page;
+          is_link_hints_shown = !is_link_hints_shown;
+          // the numbers are drawn over the lines
+          if(!is_link_hints_shown && page_has_lines(hinted_page)) {
+            werase(main_win);
+            print_page(hinted_page, main_win, hinted_page->first_line_index, main_win_y, NULL);
+          }
+          break;
+
+        // the link with the typed number is selected right away, 
+        // so "12" selects the first link and then the twelfth
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':;
+          struct page_t *page = is_offline ? &offline : gem_page;
+          typed_link_number = typed_link_number * 10 + ch - '0';
+          if(jump_to_link(page, main_win, typed_link_number, main_win_y, NULL)) {
+            current_mode = LINKS_MODE;
+            print_current_mode();
+            info_bar_print("%d: %s", typed_link_number, page_line(page, page->selected_link_index)->link);
+          }
+          else {
+            info_bar_print("There's no link %d", typed_link_number);
+            typed_link_number = 0;
+          }
+          break;
        
 //        case 'O':
 //        case 'o':
@@ -2216,6 +2689,11 @@ int main(int argc, char **argv) {
 //          } 
 //          break;
 
+        case 'U':
+          if(!is_offline)
+            upload_titan_file(gem_tls, gem_page, &resp);
+          break;
+
         case 'S':
         case 's':
           if(!gem_page->url || resp == NULL) break;
@@ -2244,7 +2722,7 @@ int main(int argc, char **argv) {
                  gem_page->selected_link_index > gem_page->lines_num
                 ) break;
               
-              char *link = gem_page->lines[gem_page->selected_link_index]->link;
+              char *link = page_line(gem_page, gem_page->selected_link_index)->link;
               if((url = handle_link_click(gem_page->url, link, gem_page, resp)) == NULL) 
                 break;
 
@@ -2259,29 +2737,22 @@ int main(int argc, char **argv) {
 
               if(res) {
                 curs_set(0);
-                form_driver(search_form, REQ_CLR_FIELD);
-                set_field_buffer(search_field[1], 0, gem_page->url);
-                refresh();
+                lineedit_set(&url_bar, gem_page->url);
+                refresh_windows();
               }
             }
           }
           break;
 
+        case KEY_LEFT:
+        case KEY_RIGHT:
+          if(!is_offline)
+            go_history(ch == KEY_LEFT ? -1 : 1, gem_tls, gem_page, &resp);
+          break;
+
         case KEY_MOUSE:
-        // "For example, in xterm, wheel/scrolling mice send
-        // position reports as a sequence of presses of buttons  4  or  5  without
-        // matching button-releases."
-        // https://invisible-island.net/ncurses/man/curs_mouse.3x.html#h3-Mouse-events
-        
-        if(getmouse(&event) == OK){ 
-          if(event.bstate & BUTTON5_PRESSED)
-            for(int i = 0; i < scrolling_velocity; i++)
-              scrolldown(gem_page, main_win, main_win_y, NULL);
-          else if (event.bstate & BUTTON4_PRESSED)
-            for(int i = 0; i < scrolling_velocity; i++)
-              scrollup(gem_page, main_win, NULL);
-        }
-        break;
+          scroll_by(is_offline ? &offline : gem_page, main_win, drain_scroll(scroll_lines(ch, &event)), main_win_y);
+          break;
       }
     }
 
@@ -2292,40 +2763,16 @@ int main(int argc, char **argv) {
           current_focus = MAIN_WINDOW;
           curs_set(0);
           if(gem_page->url)
-            set_field_buffer(search_field[1], 0, gem_page->url);
-          form_driver(search_form, REQ_PREV_FIELD);
-          form_driver(search_form, REQ_END_LINE);
-          break;
-      
-        case KEY_LEFT:
-          form_driver(search_form, REQ_PREV_CHAR);
-          break;
-
-        case KEY_RIGHT:
-          form_driver(search_form, REQ_NEXT_CHAR);
-          break;
-
-        case KEY_BACKSPACE:
-        case 127:
-          form_driver(search_form, REQ_DEL_PREV);
+            lineedit_set(&url_bar, gem_page->url);
           break;
 
-        // Delete the char under the cursor
-        case KEY_DC:
-          form_driver(search_form, REQ_DEL_CHAR);
-          break;
-        
         // https://en.wikipedia.org/wiki/Control_character#How_control_characters_map_to_keyboards
-        // ctrl + w
-        case 'W' - 64:
-          form_driver(search_form, REQ_VALIDATION);
-
-          char *search_str = field_buffer(search_field[1], 0);
-          if(!search_str || !*search_str) break;
-          
-          char search_buf[1024];
-          strncpy(search_buf, search_str, sizeof(search_buf));
+        // ctrl + w, in the url bar it goes back to the previous slash
+        case 'W' - 64:;
+          char search_buf[LINEEDIT_MAX + 1];
+          strcpy(search_buf, lineedit_text(&url_bar));
           trim_whitespaces(search_buf);
+          if(!*search_buf) break;
 
           char *slash = NULL;
 loop:
@@ -2339,36 +2786,18 @@ loop:
           }
           else
             search_buf[0] = '\0';
-          if(!*search_buf)
-            form_driver(search_form, REQ_CLR_FIELD);
-          else
-            set_field_buffer(search_field[1], 0, search_buf);
 
-          form_driver(search_form, REQ_PREV_FIELD);
-          form_driver(search_form, REQ_END_LINE);
+          lineedit_set(&url_bar, search_buf);
+          lineedit_end(&url_bar);
           break;
 
-
         case 10: //Enter 
-          /*
-          https://tldp.org/HOWTO/NCURSES-Programming-HOWTO/forms.html
-
-          To guarantee that right status is returned, call field_status() either
-          (1) in the field's exit validation check routine,
-          (2) from the field's or form's initialization or termination hooks, or
-          (3) just after a REQ_VALIDATION request has been processed by the forms driver
-          */
-          form_driver(search_form, REQ_VALIDATION);
-         
-          char *url = trim_whitespaces(field_buffer(search_field[1], 0));
-          wmove(main_win, 0, 0);
-          form_driver(search_form, REQ_PREV_FIELD);
+          ;
+          char *url = lineedit_strdup(&url_bar);
 
           // go back to main window
           current_focus = MAIN_WINDOW;
           curs_set(0);
-          form_driver(search_form, REQ_PREV_FIELD);
-          form_driver(search_form, REQ_END_LINE);
 
           request_gem_page(
               url, 
@@ -2376,12 +2805,47 @@ loop:
               gem_page, 
               &resp
           );
-          
+          free(url);
           break;
 
         default:
-          form_driver(search_form, ch);
+          lineedit_key(&url_bar, ch);
+          break;
+      }
+    }
+    else if(current_focus == OUTLINE_DIALOG) {
+      struct page_t *page = is_offline ? &offline : gem_page;
+      switch(ch) {
+        case KEY_DOWN:
+          nextlink(&outline, dialog_subwin, dialog_subwin_y, NULL);
+          break;
+        case KEY_UP:
+          prevlink(&outline, dialog_subwin, dialog_subwin_y, NULL);
           break;
+        case KEY_NPAGE:
+          pagedown(&outline, dialog_subwin, dialog_subwin_y, NULL);
+          break;
+        case KEY_PPAGE:
+          pageup(&outline, dialog_subwin, dialog_subwin_y, NULL);
+          break;
+        case 10:
+          if(outline.selected_link_index != -1) {
+            int heading = layout_link_from(&outline, outline.selected_link_index);
+            hide_dialog();
+            show_heading(page, main_win, heading, main_win_y);
+          }
+          break;
+        case KEY_LEFT:
+        case KEY_RIGHT:
+        case 'T':
+        case 't':
+          hide_dialog();
+          break;
+      }
+
+      if(current_focus == OUTLINE_DIALOG) {
+        draw_scrollbar(dialog_subwin, &outline, dialog_subwin_y, dialog_win_x - 2 - offset_x);
+        refresh_windows();
       }
     }
     else if(current_focus == BOOKMARKS_DIALOG) {
@@ -2456,7 +2920,7 @@ loop:
           if(!is_offline) {
             if(bookmarks.selected_link_index == -1) break;
             
-            char *url = bookmarks.lines[bookmarks.selected_link_index]->link;
+            char *url = page_line(&bookmarks, bookmarks.selected_link_index)->link;
             if(!url) break;
       
             int res = request_gem_page(
@@ -2478,36 +2942,33 @@ loop:
               strcpy(tmp_path, SAVED_DIR);
               strcat(tmp_path, offline_path);
 //              if(strcmp(offline_dirs.lines[offline_dirs.selected_link_index]->text, "../") == 0) 
-              strcat(tmp_path, offline_dirs.lines[offline_dirs.selected_link_index]->text);
+              strcat(tmp_path, page_line(&offline_dirs, offline_dirs.selected_link_index)->text);
               struct stat statbuf;
               stat(tmp_path, &statbuf);
               bool is_dir = S_ISDIR(statbuf.st_mode);
 
               if(is_dir) {
                 strcpy(tmp_path, offline_path);
-                strcat(tmp_path, offline_dirs.lines[offline_dirs.selected_link_index]->text);
-                char **dir_paragraphs = load_dirs(tmp_path, &n_dirs);
-                if(offline_dirs.lines) 
-                  free_lines(&offline_dirs);
-                
-                offline_dirs.lines = paragraphs_to_lines(
+                strcat(tmp_path, page_line(&offline_dirs, offline_dirs.selected_link_index)->text);
+                struct arena dirs_arena = {0};
+                char **dir_paragraphs = load_dirs(&dirs_arena, tmp_path, &n_dirs);
+                layout_links(
                   &offline_dirs,
                   dir_paragraphs, 
                   n_dirs, 
-                  main_win_x, 
-                  true
+                  main_win_x - offset_x
                 );
-                free_paragraphs(dir_paragraphs, n_dirs);
+                arena_free(&dirs_arena);
                 wclear(dialog_subwin);
                 print_page(&offline_dirs, dialog_subwin, 0, dialog_subwin_y, NULL);
-                wrefresh(dialog_win);
+                refresh_windows();
                 strcpy(offline_path, tmp_path);
               }
               else {
                 
                 strcpy(tmp_path, SAVED_DIR);
                 strcat(tmp_path, offline_path);
-                strcat(tmp_path, offline_dirs.lines[offline_dirs.selected_link_index]->text);
+                strcat(tmp_path, page_line(&offline_dirs, offline_dirs.selected_link_index)->text);
                 
                 fprintf(stderr, "%s", tmp_path);
                 FILE *f = fopen(tmp_path, "rb");
@@ -2535,17 +2996,10 @@ loop:
                 }
                 fclose(f);
           
-                int n_paragraphs = 0;
-                char **paragraphs = string_to_paragraphs(buffer, &n_paragraphs);
-                offline.lines = paragraphs_to_lines(
-                  &offline, 
-                  paragraphs, 
-                  n_paragraphs, 
-                  main_win_x, 
-                  false
-                );
-      
-                free_paragraphs(paragraphs, n_paragraphs);
+                layout_free(&offline);
+                gemtext_free(&offline.doc);
+                gemtext_parse_init(&offline.doc, buffer, fsize);
+                layout_gemtext(&offline, main_win_x - offset_x);
                 wclear(main_win);
                 print_page(&offline, main_win, 0, main_win_y, NULL);
                 hide_dialog();
@@ -2557,20 +3011,30 @@ loop:
       }
 refresh_bookmarks:    
       draw_scrollbar(dialog_subwin, &bookmarks, dialog_subwin_y, dialog_win_x - 2 - 1);
-      update_panels();
-      wrefresh(dialog_subwin);
+      refresh_windows();
     }
     
     if(ch == KEY_RESIZE){
+      wait_for_last_resize();
       resize_screen(gem_page, resp);
     }
   } 
-  free_lines(&bookmarks);
+  layout_destroy(&bookmarks);
+  layout_destroy(&outline);
   if(gem_page->url)
     free(gem_page->url);
-  free_lines(gem_page);
+  layout_destroy(gem_page);
+  gemtext_free(&gem_page->doc);
+  search_free(&page_search);
   free(gem_page);
+  history_free();
+  // a revalidation may be still using the tls
+  cache_save();
+  cache_free();
   tls_free(gem_tls);
-  free_resp(resp);
+  hoststats_save();
+  hoststats_free();
+  pool_free();
+  response_free(resp);
   free_windows();
 }
@@ -1,114 +1,108 @@
-#include <stdlib.h>
-//#include <wchar.h>
-//#include <wctype.h>
-#include "wcwidth.h"
+#include "utf8.h"
+
+// all of these work on whole utf8 characters, n is in characters unless said otherwise
 
 wchar_t get_wchar(const char *s) {
-  wchar_t buffer[2];
-  //swprintf(buffer, 2, L"%hs", s);  
-  mbstowcs(buffer, s, 2);  
-  return buffer[0];
+  uint32_t cp;
+  utf8_decode(s, &cp);
+  return cp;
 }
 
 int utf8_get_char_width(const char *s) {
-  wchar_t wc = get_wchar(s);
-  // If wc is a NULL or non-spacing wide character, wcwidth() returns 0.
-  // If wc is not a printing wide character, wcwidth() returns -1. 
-  int ret = mk_wcwidth(wc);
-  // for what i understand, not a printing wide character may be for example an Invisible Operator.
-  // eg. Invisible Plus "To ensure that 3¼ means 3 plus ¼—in uses where it is not possible to rely on a human 
-  // reader to disambiguate the implied intent of juxtaposition—the invisible plus operator is
-  // used. In such uses, not having an operator at all would imply multiplication."
-  // https://www.unicode.org/versions/Unicode13.0.0/ch22.pdf
-  if(ret == -1)
-    ret = 0;
+  uint32_t cp;
+  utf8_decode(s, &cp);
+  return utf8_cp_width(cp);
+}
 
-  return ret;
+int utf8_char_bytes(const char *s) {
+  uint32_t cp;
+  return utf8_decode(s, &cp);
 }
 
 int utf8_to_bytes(char *s, int n) {
-  int len = 0, all_bytes = 0;
-  unsigned char *p = (unsigned char*)s;
-  while(*p && len != n) {
-    int j = 1;
-    if(*p & 0x80) {
-      while((*p << j) & 0x80) j++;
-    }
-    p += j;
-    all_bytes += j;
-    len++;
-  }
-  return all_bytes;
+  uint32_t cp;
+  const char *p = s;
+  for(int chars_n = 0; *p && chars_n != n; chars_n++)
+    p += utf8_decode(p, &cp);
+  return p - s;
 }
 
 int utf8_strwidth(char *s) {
-  int len = 0;
-  unsigned char *p = (unsigned char*)s;
-  while(*p != '\0') {
-    len += utf8_get_char_width((const char*)p);
-    int j = 1;
-    if(*p & 0x80) {
-      while((*p << j) & 0x80) j++;
-    }
-    p += j;
-  }
-  return len; 
+  return utf8_strnwidth(s, -1);
 }
 
-
-
 int utf8_strnwidth(char *s, int n) {
-  int chars_n = 0;
+  uint32_t cp;
   int len = 0;
-  unsigned char *p = (unsigned char*)s;
-  while(*p != '\0' && chars_n != n) {
-    len += utf8_get_char_width((const char*)p);
-    chars_n++;
-    int j = 1;
-    if(*p & 0x80) {
-      while((*p << j) & 0x80) j++;
-    }
-    p += j;
+  for(int chars_n = 0; *s && chars_n != n; chars_n++) {
+    s += utf8_decode(s, &cp);
+    len += utf8_cp_width(cp);
   }
   return len;
 }
 
 int utf8_max_chars_in_width(char *s, int n) {
-  int chars_n = 0;
-  int len = 0;
-  unsigned char *p = (unsigned char*)s;
-  while(*p != '\0') {
-    if (len + utf8_get_char_width((const char*)p) > n)
+  uint32_t cp;
+  int chars_n = 0, len = 0;
+  while(*s) {
+    int j = utf8_decode(s, &cp);
+    int w = utf8_cp_width(cp);
+    if(len + w > n)
       break;
-    
-    len += utf8_get_char_width((const char*)p);
+    len += w;
+    s += j;
     chars_n++;
-    int j = 1;
-    if(*p & 0x80) {
-      while((*p << j) & 0x80) j++;
-    }
-    p += j;
   }
   return chars_n;
 }
 
-
-
 int utf8_max_chars_in_bytes(const char *s, int n) {
-  int chars_n = 0;
-  int len = 0;
-  unsigned char *p = (unsigned char*)s;
-  while(*p) {
-    int j = 1;
-    if(*p & 0x80) {
-      while((*p << j) & 0x80) j++;
-    }
+  uint32_t cp;
+  int chars_n = 0, len = 0;
+  while(*s) {
+    int j = utf8_decode(s, &cp);
     if(len + j > n)
       break;
-    
-    p += j;
+    s += j;
     len += j;
-    chars_n += 1;
+    chars_n++;
   }
   return chars_n;
 }
+
+int utf8_span_width(const char *s, int bytes) {
+  uint32_t cp;
+  int len = 0;
+  const char *end = s + bytes;
+  while(s < end) {
+    s += utf8_decode(s, &cp);
+    len += utf8_cp_width(cp);
+  }
+  return len;
+}
+
+int utf8_span_drawn_width(const char *s, int bytes, int column) {
+  uint32_t cp;
+  int start = column;
+  const char *end = s + bytes;
+  while(s < end) {
+    s += utf8_decode(s, &cp);
+    column += utf8_cp_drawn_width(cp, column);
+  }
+  return column - start;
+}
+
+int utf8_span_bytes_in_width(const char *s, int bytes, int width) {
+  uint32_t cp;
+  int len = 0;
+  const char *p = s, *end = s + bytes;
+  while(p < end) {
+    int j = utf8_decode(p, &cp);
+    int w = utf8_cp_width(cp);
+    if(len + w > width || p + j > end)
+      break;
+    len += w;
+    p += j;
+  }
+  return p - s;
+}
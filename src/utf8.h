@@ -1,6 +1,88 @@
 #ifndef UTF8_H
 #define UTF8_H
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <wchar.h>
+
+// generated at build time by scripts/gen_width_table.c
+#include "width_table.h"
+
+#define UTF8_REPLACEMENT_CHAR 0xFFFD
+
+// decodes one codepoint from s, returns how many bytes it took
+// doesn't depend on the locale, invalid sequences are U+FFFD and take one byte
+// reads nothing past a '\0' (or any other non continuation byte)
+static inline int utf8_decode(const char *str, uint32_t *cp) {
+  const unsigned char *s = (const unsigned char*)str;
+  unsigned char c = s[0];
+
+  if(c < 0x80) {
+    *cp = c;
+    return 1;
+  }
+  if(c >= 0xC2 && c <= 0xDF) {
+    if((s[1] & 0xC0) == 0x80) {
+      *cp = ((c & 0x1F) << 6) | (s[1] & 0x3F);
+      return 2;
+    }
+  }
+  else if(c >= 0xE0 && c <= 0xEF) {
+    if((s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+      uint32_t r = ((c & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+      // overlong or a surrogate
+      if(r >= 0x800 && (r < 0xD800 || r > 0xDFFF)) {
+        *cp = r;
+        return 3;
+      }
+    }
+  }
+  else if(c >= 0xF0 && c <= 0xF4) {
+    if((s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80 && (s[3] & 0xC0) == 0x80) {
+      uint32_t r = ((c & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+      if(r >= 0x10000 && r < WIDTH_MAX_CODEPOINT) {
+        *cp = r;
+        return 4;
+      }
+    }
+  }
+
+  *cp = UTF8_REPLACEMENT_CHAR;
+  return 1;
+}
+
+// columns the codepoint takes on the screen (0, 1 or 2)
+static inline int utf8_cp_width(uint32_t cp) {
+  if(cp >= WIDTH_MAX_CODEPOINT)
+    return 1;
+  return width_stage2[width_stage1[cp >> WIDTH_BLOCK_SHIFT]][cp & WIDTH_BLOCK_MASK];
+}
+
+#define UTF8_TAB_SIZE 8
+
+// columns the codepoint takes where it's drawn, column is from the start of the line,
+// a tab goes to the next tab stop, a control character is shown as ^X, a C1 one as U+FFFD,
+// a combining character goes into the cell before it, or a blank one at the start
+// (layout measures lines with it, so they're as long as render_line draws them)
+static inline int utf8_cp_drawn_width(uint32_t cp, int column) {
+  if(cp == '\t')
+    return UTF8_TAB_SIZE - column % UTF8_TAB_SIZE;
+  if(cp < 0x20 || cp == 0x7F)
+    return 2;
+  if(cp >= 0x80 && cp < 0xA0)
+    return 1;
+  int width = utf8_cp_width(cp);
+  return width == 0 && column == 0 ? 1 : width;
+}
+
+// where a line can be broken, the same set as iswspace() in glibc (so no no-break spaces)
+static inline bool utf8_cp_is_space(uint32_t cp) {
+  if(cp < 0x80)
+    return cp == ' ' || (cp >= '\t' && cp <= '\r');
+  return cp == 0x1680 || 
+    (cp >= 0x2000 && cp <= 0x200A && cp != 0x2007) || 
+    cp == 0x2028 || cp == 0x2029 || cp == 0x205F || cp == 0x3000;
+}
 
 wchar_t get_wchar(const char *s);
 int utf8_get_char_width(const char *s);
@@ -10,4 +92,12 @@ int utf8_strnwidth(char *s, int n);
 int utf8_max_chars_in_width(char *s, int n);
 int utf8_max_chars_in_bytes(const char *s, int n);
 
+// the same on not null terminated strings of the given length in bytes
+int utf8_char_bytes(const char *s);
+int utf8_span_width(const char *s, int bytes);
+// how many bytes (whole characters) of s fit into width columns
+int utf8_span_bytes_in_width(const char *s, int bytes, int width);
+// the columns from column on, measured with utf8_cp_drawn_width
+int utf8_span_drawn_width(const char *s, int bytes, int column);
+
 #endif
@@ -1,5 +1,7 @@
 #include "util.h"
+#include "io.h"
 #include <time.h>
+#include <errno.h>
 
 char percentage_encode_chars[][4] = {
   ":", "%3A",
@@ -30,6 +32,12 @@ void get_datatime(char buf[], int size) {
   strftime(buf, size, "%Y-%m-%d %X", &tstruct);
 }
 
+double get_monotonic_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
 int get_valid_query(char **query) {
   
   if(query == NULL || *query == NULL || **query == '\0')
@@ -83,6 +91,17 @@ void open_link(char *link) {
   }
 }
 
+// "spartan://host/path" -> "host/path", urls without a scheme are returned as they are
+char *skip_url_scheme(char *url) {
+  char *p = url;
+  while(isalnum((unsigned char)*p) || *p == '+' || *p == '-' || *p == '.')
+    p++;
+
+  if(p != url && strncmp(p, "://", 3) == 0)
+    return p + 3;
+  return url;
+}
+
 int get_default_app(char *mime_type, char default_app[NAME_MAX + 1]) {
   char buf[NAME_MAX + 1];
   char cache_path[PATH_MAX + 1];
@@ -164,6 +183,16 @@ err:
   return 0;
 }
 
+// with the dirs it's in, if they aren't there either
+static void make_dirs(char *path) {
+  for(char *slash = strchr(path + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    mkdir(path, 0700);
+    *slash = '/';
+  }
+  mkdir(path, 0700);
+}
+
 void get_cache_path(char *cache_path, int size) {
   char *xdg_cache_home = getenv("XDG_CACHE_HOME");
   if(xdg_cache_home) {
@@ -186,7 +215,7 @@ create_dir:;
   // add a new cache dir if it doesn't exist yes
   struct stat st;
   if(stat(cache_path, &st) == -1)
-    mkdir(cache_path, 0700);
+    make_dirs(cache_path);
   
   return;
 }
@@ -210,7 +239,7 @@ create_dir:;
   // add a new data dir if it doesn't exist yes
   struct stat st;
   if(stat(data_path, &st) == -1)
-    mkdir(data_path, 0700);
+    make_dirs(data_path);
   
   return;
 }
@@ -298,13 +327,12 @@ err:
 }
 
 
-void write_file(char *buf, char *save_path, int size, int offset) {
-  FILE *f = fopen(save_path, "wb");
-  if(f == NULL) 
-    ERROR_LOG_AND_EXIT("can't open save_path");
-  
-  fwrite(buf + offset, sizeof(char), size - offset, f);
-  fclose(f);
+int write_file(char *buf, char *save_path, int size, int offset) {
+  if(!io_write_file(save_path, buf + offset, size - offset, IO_TRUNCATE)) {
+    ERROR_LOG("Can't write %s: %s", save_path, strerror(errno));
+    return 0;
+  }
+  return 1;
 }
 
 void exec_app(char *app, char *path) {
@@ -328,9 +356,7 @@ int save_file(char save_path[PATH_MAX + 1], char *buf, char *filename, int size,
   
   strcat(save_path, "/");  
   strcat(save_path, filename);  
-  write_file(buf, save_path, size, offset);
-
-  return 1;
+  return write_file(buf, save_path, size, offset);
 }
 
 
@@ -340,7 +366,8 @@ int open_file(char *buf, char *filename, char *app, int size, int offset) {
   get_cache_path(save_path, sizeof(save_path));
   strcat(save_path, "/");
   strcat(save_path, filename);
-  write_file(buf, save_path, size, offset);
+  if(!write_file(buf, save_path, size, offset))
+    return 0;
 
   exec_app(app, save_path);
   return 1;
@@ -359,7 +386,7 @@ int save_gemsite(char save_path[PATH_MAX + 1], int buf_size, char *url, struct r
   char data_path[PATH_MAX - 20];
   get_data_path(data_path, sizeof(data_path));
   
-  if(strncmp(url, "gemini://", 9) == 0) url += 9;
+  url = skip_url_scheme(url);
 
   if((ssize_t)strlen(data_path) + (ssize_t)strlen(url) >= buf_size) {
     ERROR_LOG("Url (%s) and data_path (%s) are longer than PATH_MAX", url, data_path);
@@ -421,7 +448,8 @@ int save_gemsite(char save_path[PATH_MAX + 1], int buf_size, char *url, struct r
   
   strcat(save_path, timestamp);
 
-  write_file(resp->body, save_path, resp->body_size, 0);
+  if(!write_file(resp->body, save_path, resp->body_size, 0))
+    return 0;
   INFO_LOG("saved gemsite: %s", save_path);
 
   return 1;
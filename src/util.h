@@ -33,6 +33,7 @@
 
 
 void get_datatime(char *buf, int size);
+double get_monotonic_ms(void);
 void get_data_path(char *data_path, int size); 
 //void get_cache_path(char *cache_path, int size);
 void get_file_path_in_data_dir(const char *filename, char buffer[], int size);
@@ -43,6 +44,7 @@ int open_file(char *buf, char *filename, char *app, int size, int offset);
 int save_file(char save_path[PATH_MAX + 1], char *buf, char *filename, int size, int offset);
 int save_gemsite(char save_path[PATH_MAX + 1], int buf_size, char *url, struct response *resp);
 void open_link(char *link);
+char *skip_url_scheme(char *url);
 
 void free_char_pp(char **p, int n);
 